@@ -0,0 +1,680 @@
+
+#include "config/ParseConfig.h"
+#include "config/ParseKeySequence.h"
+#include "runtime/create_multi_stage.h"
+#include "client/ServerPort.h"
+#include "server/ClientPort.h"
+#include "common/output.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <functional>
+#include <map>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <string_view>
+#include <thread>
+
+#if !defined(_WIN32)
+# include "server/unix/SpscQueue.h"
+# include "server/unix/Wakeup.h"
+# include <poll.h>
+#endif
+
+namespace {
+  using Parameters = std::vector<std::pair<std::string, std::string>>;
+
+  struct Settings {
+    std::string filter;
+    std::string output_filename;
+    std::string baseline_filename;
+    double tolerance_percent{ 10 };
+    bool quick{ };
+  };
+
+  struct Benchmark {
+    std::string name;
+    Parameters parameters;
+    // returns the number of performed operations
+    std::function<size_t()> run;
+  };
+
+  struct Result {
+    std::string id;
+    const Benchmark* benchmark;
+    size_t operations;
+    double ns_per_op;
+    double min_ns_per_op;
+    std::optional<double> baseline_ns_per_op;
+  };
+
+  using Clock = std::chrono::steady_clock;
+
+  // prevents the compiler from optimizing away unused results
+  volatile size_t g_sink;
+
+  const auto mapping_keys = std::vector<std::string_view>{
+    "A", "B", "C", "D", "E", "F", "G", "H", "I", "J", "K", "L", "M",
+    "N", "O", "P", "Q", "R", "S", "T", "U", "V", "W", "X", "Y", "Z",
+    "1", "2", "3", "4", "5", "6", "7", "8", "9", "0",
+    "F1", "F2", "F3", "F4", "F5", "F6", "F7", "F8", "F9", "F10", "F11", "F12",
+    "Tab", "Space", "Enter", "Backspace", "Comma", "Period",
+    "ArrowLeft", "ArrowRight", "ArrowUp", "ArrowDown",
+  };
+
+  const auto mapping_modifiers = std::vector<std::string_view>{
+    "Control", "Shift", "Alt", "Meta", "Control Shift", "Control Alt",
+  };
+
+  const auto typed_text = std::string_view(
+    "The quick brown fox jumps over the lazy dog. Keymapper is a "
+    "cross-platform context-aware key remapper, it allows to redefine "
+    "the keyboard layout, to define application specific shortcuts "
+    "and to automate tasks. Pack my box with five dozen liquor jugs, "
+    "how vexingly quick daft zebras jump.");
+
+  const auto typed_shortcuts = std::vector<std::vector<std::string_view>>{
+    { "ControlLeft", "C" }, { "ControlLeft", "V" }, { "AltLeft", "Tab" },
+    { "ShiftLeft", "ArrowLeft" }, { "ShiftLeft", "ArrowLeft" },
+    { "ControlLeft", "X" }, { "ArrowDown" }, { "ControlLeft", "V" },
+    { "MetaLeft", "D" }, { "ControlLeft", "ShiftLeft", "T" },
+    { "ControlLeft", "Z" }, { "Enter" }, { "ControlLeft", "S" },
+    { "AltLeft", "F4" }, { "F5" }, { "ControlLeft", "AltLeft", "Delete" },
+  };
+
+  // deterministic, unlike the standard distributions
+  class Random {
+  public:
+    size_t operator()(size_t count) { return m_engine() % count; }
+
+  private:
+    std::mt19937 m_engine{ 20190101 };
+  };
+
+  std::string generate_input(Random& random, size_t index) {
+    const auto key = [&]() { return std::string(mapping_keys[random(mapping_keys.size())]); };
+    switch (index % 4) {
+      case 0:  return std::string(mapping_modifiers[random(mapping_modifiers.size())]) + "{" + key() + "}";
+      case 1:  return key() + " " + key();
+      case 2:  return "(" + key() + " " + key() + ")";
+      default: return key();
+    }
+  }
+
+  std::string generate_output(Random& random, size_t index) {
+    const auto key = std::string(mapping_keys[random(mapping_keys.size())]);
+    if (index % 3 == 2)
+      return std::string(mapping_modifiers[random(mapping_modifiers.size())]) + "{" + key + "}";
+    return key;
+  }
+
+  // mappings are evenly distributed over the contexts,
+  // which are evenly distributed over the stages
+  std::string generate_config(size_t mappings, size_t contexts, size_t stages) {
+    auto random = Random();
+    auto config = std::ostringstream();
+    auto mapping = size_t{ };
+    for (auto context = size_t{ }; context < contexts; ++context) {
+      if (context > 0 && context * stages / contexts != (context - 1) * stages / contexts)
+        config << "[stage]\n";
+      if (context > 0)
+        config << "[title=\"Window " << context << "\"]\n";
+      for (const auto end = (context + 1) * mappings / contexts; mapping < end; ++mapping)
+        config << generate_input(random, mapping) << " >> "
+               << generate_output(random, mapping) << "\n";
+    }
+    return config.str();
+  }
+
+  Config parse_config(const std::string& string) {
+    auto stream = std::istringstream(string);
+    auto parse_config = ParseConfig();
+    return parse_config(stream);
+  }
+
+  MultiStagePtr create_active_multi_stage(Config config) {
+    auto multi_stage = create_multi_stage(config);
+    // the worst case, all contexts are active
+    auto indices = std::vector<int>(multi_stage->context_count());
+    std::iota(indices.begin(), indices.end(), 0);
+    multi_stage->set_active_client_contexts(indices);
+    return multi_stage;
+  }
+
+  void add_stroke(KeySequence& trace, const std::vector<Key>& keys) {
+    for (auto key : keys)
+      trace.emplace_back(key, KeyState::Down);
+    for (auto it = keys.rbegin(); it != keys.rend(); ++it)
+      trace.emplace_back(*it, KeyState::Up);
+  }
+
+  KeySequence generate_text_trace() {
+    auto trace = KeySequence();
+    for (auto character : typed_text) {
+      auto keys = std::vector<Key>();
+      if (std::isupper(static_cast<unsigned char>(character)))
+        keys.push_back(Key::ShiftLeft);
+      keys.push_back(
+        character == ' ' ? Key::Space :
+        character == '.' ? Key::Period :
+        character == ',' ? Key::Comma :
+        character == '-' ? Key::Minus :
+        get_key_by_name(std::string(1, static_cast<char>(
+          std::toupper(static_cast<unsigned char>(character))))));
+      add_stroke(trace, keys);
+    }
+    return trace;
+  }
+
+  KeySequence generate_shortcuts_trace() {
+    auto trace = KeySequence();
+    for (const auto& shortcut : typed_shortcuts) {
+      auto keys = std::vector<Key>();
+      for (auto key_name : shortcut)
+        keys.push_back(get_key_by_name(key_name));
+      add_stroke(trace, keys);
+    }
+    return trace;
+  }
+
+  const KeySequence& get_trace(const std::string& name) {
+    static const auto text = generate_text_trace();
+    static const auto shortcuts = generate_shortcuts_trace();
+    return (name == "text" ? text : shortcuts);
+  }
+
+  // all subsequences the stage matches the inputs against while typing
+  std::vector<KeySequence> get_match_sequences(const KeySequence& trace) {
+    auto sequences = std::vector<KeySequence>();
+    for (auto length = 1u; length <= 3; ++length)
+      for (auto i = 0u; i + length <= trace.size(); ++i)
+        if (trace[i].state == KeyState::Down) {
+          auto& sequence = sequences.emplace_back();
+          sequence.assign(trace.begin() + i, trace.begin() + i + length);
+        }
+    return sequences;
+  }
+
+  std::vector<std::pair<std::string, bool>> get_parse_expressions() {
+    auto expressions = std::vector<std::pair<std::string, bool>>{
+      { "A", true }, { "A B", true }, { "(A B)", true }, { "A{B C}", true },
+      { "(A B){C D}", true }, { "Shift{A} !500ms", true },
+      { "Control{Any}", true }, { "A !Shift B", true },
+      { "A", false }, { "A B C", false }, { "Control{A}", false },
+      { "Shift{(A B)} C", false }, { "Control{Alt{Delete}}", false },
+      { "A ^ B", false }, { "$(ls -la)", false },
+    };
+    auto random = Random();
+    for (auto i = 0u; i < 100; ++i)
+      expressions.emplace_back((i % 2 ? generate_input(random, i) :
+        generate_output(random, i)), (i % 2 != 0));
+    return expressions;
+  }
+
+  size_t run_parse_key_sequence() {
+    static const auto expressions = get_parse_expressions();
+    static auto parse = ParseKeySequence();
+    for (const auto& [expression, is_input] : expressions)
+      g_sink = g_sink + parse(expression, is_input, get_key_by_name,
+        [](std::string_view) { return Key::any; }).size();
+    return expressions.size();
+  }
+
+  size_t run_parse_config(const std::string& config) {
+    g_sink = g_sink + parse_config(config).contexts.size();
+    return 1;
+  }
+
+  size_t run_match_key_sequence(const std::vector<KeySequence>& inputs,
+      const std::vector<KeySequence>& sequences) {
+    static auto match = MatchKeySequence();
+    auto any_key_matches = std::vector<Key>();
+    auto input_timeout_event = KeyEvent();
+    for (const auto& input : inputs)
+      for (const auto& sequence : sequences)
+        g_sink = g_sink + static_cast<size_t>(match(input, sequence,
+          true, &any_key_matches, &input_timeout_event));
+    return inputs.size() * sequences.size();
+  }
+
+  template<typename T>
+  size_t run_update(T& stage, const KeySequence& trace) {
+    for (const auto& event : trace) {
+      auto output = stage.update(event, 0);
+      g_sink = g_sink + output.size();
+      stage.reuse_buffer(std::move(output));
+    }
+    return trace.size();
+  }
+
+  // a connected keymapper and keymapperd port, which answer requests
+  class IpcConnection : public IClientPort::MessageHandler,
+                        public ServerPort::MessageHandler {
+  public:
+    IpcConnection()
+      : m_client_port("keymapper-bench"),
+        m_server_port("keymapper-bench") {
+    }
+
+    bool connect() {
+      if (!m_client_port.listen())
+        return false;
+      auto connected = false;
+      auto thread = std::thread([&]() { connected = m_server_port.connect(); });
+      const auto accepted = m_client_port.accept();
+      thread.join();
+      return (accepted && connected);
+    }
+
+    // sends a request and waits for the reply
+    bool round_trip() {
+      m_replied = false;
+      if (!m_server_port.send_request_statistics())
+        return false;
+      while (!m_replied)
+        if (!m_client_port.read_messages(*this, std::nullopt) ||
+            !m_server_port.read_messages(*this, std::nullopt))
+          return false;
+      return true;
+    }
+
+  private:
+    // keymapperd
+    void on_request_statistics_message() override {
+      m_client_port.send_statistics("statistics");
+    }
+    void on_configuration_message(MultiStagePtr stage) override { }
+    void on_grab_device_filters_message(std::vector<GrabDeviceFilter> filters) override { }
+    void on_directives_message(const std::vector<std::string>& directives) override { }
+    void on_active_contexts_message(const std::vector<int>& context_indices) override { }
+    void on_set_virtual_key_state_message(Key key, KeyState state) override { }
+    void on_validate_state_message() override { }
+    void on_request_next_key_info_message() override { }
+    void on_request_mapping_profile_message(bool start) override { }
+    void on_request_trace_message(bool start) override { }
+    void on_inject_input_message(const KeySequence& sequence) override { }
+    void on_inject_output_message(const KeySequence& sequence) override { }
+
+    // keymapper
+    void on_statistics_message(const std::string& statistics) override {
+      m_replied = true;
+    }
+    void on_execute_action_message(int action_index) override { }
+    void on_virtual_key_state_message(Key key, KeyState state) override { }
+    void on_next_key_info_message(const std::vector<Key>& keys, DeviceDesc device) override { }
+    void on_mapping_profile_message(
+      const std::vector<Stage::ContextProfile>& context_profiles) override { }
+    void on_trace_message(const std::vector<TraceRecord>& records) override { }
+
+    ClientPort m_client_port;
+    ServerPort m_server_port;
+    bool m_replied{ };
+  };
+
+  size_t run_ipc_round_trip(IpcConnection& connection) {
+    const auto count = 100;
+    for (auto i = 0; i < count; ++i)
+      if (!connection.round_trip())
+        throw std::runtime_error("IPC round trip failed");
+    return count;
+  }
+
+#if !defined(_WIN32)
+  // passes events from the reading thread through a processing and a
+  // writing thread and back, like keymapperd's pipelined mode does.
+  // in single-threaded mode, this hand-off does not exist
+  class PipelineHandoff {
+  public:
+    PipelineHandoff()
+      : m_processor([this]() { relay(m_input, m_input_wakeup, 
+          m_output, m_output_wakeup); }),
+        m_writer([this]() { relay(m_output, m_output_wakeup, 
+          m_written, m_written_wakeup); }) {
+    }
+
+    PipelineHandoff(const PipelineHandoff&) = delete;
+    PipelineHandoff& operator=(const PipelineHandoff&) = delete;
+
+    ~PipelineHandoff() {
+      push(m_input, m_input_wakeup, -1);
+      m_processor.join();
+      m_writer.join();
+    }
+
+    // returns when the event was written
+    void pass(int event) {
+      push(m_input, m_input_wakeup, event);
+      pop(m_written, m_written_wakeup);
+    }
+
+  private:
+    using Queue = SpscQueue<int, 64>;
+
+    static void push(Queue& queue, Wakeup& wakeup, int event) {
+      while (!queue.push(event))
+        std::this_thread::yield();
+      wakeup.signal();
+    }
+
+    static int pop(Queue& queue, Wakeup& wakeup) {
+      for (;;) {
+        if (auto event = queue.pop())
+          return *event;
+        wakeup.reset();
+        if (auto event = queue.pop())
+          return *event;
+        auto pfd = pollfd{ wakeup.fd(), POLLIN, 0 };
+        ::poll(&pfd, 1, -1);
+      }
+    }
+
+    static void relay(Queue& from, Wakeup& from_wakeup, 
+        Queue& to, Wakeup& to_wakeup) {
+      for (;;) {
+        const auto event = pop(from, from_wakeup);
+        push(to, to_wakeup, event);
+        if (event < 0)
+          break;
+      }
+    }
+
+    Queue m_input;
+    Queue m_output;
+    Queue m_written;
+    Wakeup m_input_wakeup;
+    Wakeup m_output_wakeup;
+    Wakeup m_written_wakeup;
+    std::thread m_processor;
+    std::thread m_writer;
+  };
+
+  size_t run_pipeline_handoff(PipelineHandoff& pipeline) {
+    const auto count = 100;
+    for (auto i = 0; i < count; ++i)
+      pipeline.pass(i);
+    return count;
+  }
+#endif // !defined(_WIN32)
+
+  std::vector<Benchmark> get_benchmarks(bool quick) {
+    auto benchmarks = std::vector<Benchmark>();
+    const auto mapping_counts = (quick ?
+      std::vector<size_t>{ 10, 1000 } :
+      std::vector<size_t>{ 10, 100, 1000, 10000 });
+    const auto context_counts = (quick ?
+      std::vector<size_t>{ 1, 100 } :
+      std::vector<size_t>{ 1, 10, 100, 500 });
+    const auto stage_counts = (quick ?
+      std::vector<size_t>{ 1, 8 } :
+      std::vector<size_t>{ 1, 2, 4, 8 });
+    const auto traces = std::vector<std::string>{ "text", "shortcuts" };
+
+    benchmarks.push_back({ "ParseKeySequence", { }, &run_parse_key_sequence });
+
+    for (auto mappings : mapping_counts) {
+      const auto contexts = std::min(mappings, size_t{ 10 });
+      benchmarks.push_back({ "ParseConfig", {
+          { "mappings", std::to_string(mappings) },
+          { "contexts", std::to_string(contexts) } },
+        [config = generate_config(mappings, contexts, 1)]() {
+          return run_parse_config(config);
+        } });
+    }
+
+    for (const auto& trace : traces) {
+      auto inputs = std::vector<KeySequence>();
+      for (auto& context : parse_config(generate_config(100, 1, 1)).contexts)
+        for (auto& input : context.inputs)
+          inputs.push_back(std::move(input.input));
+      benchmarks.push_back({ "MatchKeySequence", {
+          { "mappings", "100" }, { "trace", trace } },
+        [inputs = std::move(inputs), sequences = get_match_sequences(get_trace(trace))]() {
+          return run_match_key_sequence(inputs, sequences);
+        } });
+    }
+
+    const auto add_stage_benchmark = [&](size_t mappings, size_t contexts,
+        const std::string& trace) {
+      auto multi_stage = std::shared_ptr<MultiStage>(create_active_multi_stage(
+        parse_config(generate_config(mappings, contexts, 1))));
+      benchmarks.push_back({ "Stage::update", {
+          { "mappings", std::to_string(mappings) },
+          { "contexts", std::to_string(contexts) },
+          { "trace", trace } },
+        [multi_stage, &trace = get_trace(trace)]() {
+          return run_update(*multi_stage->stages().front(), trace);
+        } });
+    };
+    for (const auto& trace : traces) {
+      for (auto mappings : mapping_counts)
+        add_stage_benchmark(mappings, 1, trace);
+      for (auto contexts : context_counts)
+        if (contexts > 1)
+          add_stage_benchmark(1000, contexts, trace);
+    }
+
+    for (const auto& trace : traces)
+      for (auto stages : stage_counts) {
+        auto multi_stage = std::shared_ptr<MultiStage>(create_active_multi_stage(
+          parse_config(generate_config(1000, 8, stages))));
+        benchmarks.push_back({ "MultiStage::update", {
+            { "mappings", "1000" }, { "contexts", "8" },
+            { "stages", std::to_string(stages) }, { "trace", trace } },
+          [multi_stage, &trace = get_trace(trace)]() {
+            return run_update(*multi_stage, trace);
+          } });
+      }
+
+    auto connection = std::make_shared<IpcConnection>();
+    if (connection->connect())
+      benchmarks.push_back({ "IPC::round_trip", { },
+        [connection]() { return run_ipc_round_trip(*connection); } });
+    else
+      error("Connecting IPC benchmark ports failed");
+
+#if !defined(_WIN32)
+    auto pipeline = std::make_shared<PipelineHandoff>();
+    benchmarks.push_back({ "Pipeline::handoff", { },
+      [pipeline]() { return run_pipeline_handoff(*pipeline); } });
+#endif
+    return benchmarks;
+  }
+
+  std::string get_id(const Benchmark& benchmark) {
+    auto id = benchmark.name;
+    for (const auto& [name, value] : benchmark.parameters)
+      id += "/" + name + "=" + value;
+    return id;
+  }
+
+  // runs until the minimum time elapsed, returns nanoseconds per operation
+  double run_sample(const Benchmark& benchmark, Clock::duration min_time,
+      size_t* operations) {
+    const auto begin = Clock::now();
+    auto sample_operations = size_t{ };
+    auto now = begin;
+    do {
+      sample_operations += benchmark.run();
+      now = Clock::now();
+    } while (now - begin < min_time);
+    *operations += sample_operations;
+    return static_cast<double>(std::chrono::duration_cast<
+      std::chrono::nanoseconds>(now - begin).count()) / sample_operations;
+  }
+
+  Result run_benchmark(const Benchmark& benchmark, bool quick) {
+    const auto samples = (quick ? 3 : 7);
+    const auto min_time = std::chrono::milliseconds(quick ? 20 : 100);
+
+    // warm up caches and buffers
+    benchmark.run();
+
+    auto result = Result{ get_id(benchmark), &benchmark };
+    auto ns_per_op = std::vector<double>();
+    for (auto i = 0; i < samples; ++i)
+      ns_per_op.push_back(run_sample(benchmark, min_time, &result.operations));
+    std::sort(ns_per_op.begin(), ns_per_op.end());
+    result.ns_per_op = ns_per_op[ns_per_op.size() / 2];
+    result.min_ns_per_op = ns_per_op.front();
+    return result;
+  }
+
+  bool is_number(const std::string& value) {
+    return !value.empty() && std::all_of(value.begin(), value.end(),
+      [](char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+  }
+
+  std::string format_number(double value) {
+    auto buffer = std::array<char, 32>();
+    std::snprintf(buffer.data(), buffer.size(), "%.2f", value);
+    return buffer.data();
+  }
+
+  // each benchmark is written on a separate line, so baselines
+  // can be read back without a JSON parser
+  void write_json(std::ostream& os, const std::vector<Result>& results,
+      double tolerance_percent) {
+    os << "{\n  \"benchmarks\": [\n";
+    for (const auto& result : results) {
+      os << "    { \"id\": \"" << result.id << "\", \"name\": \""
+         << result.benchmark->name << "\"";
+      for (const auto& [name, value] : result.benchmark->parameters) {
+        os << ", \"" << name << "\": ";
+        if (is_number(value))
+          os << value;
+        else
+          os << "\"" << value << "\"";
+      }
+      os << ", \"operations\": " << result.operations
+         << ", \"ns_per_op\": " << format_number(result.ns_per_op)
+         << ", \"min_ns_per_op\": " << format_number(result.min_ns_per_op);
+      if (result.baseline_ns_per_op) {
+        const auto change = (result.ns_per_op / *result.baseline_ns_per_op - 1) * 100;
+        os << ", \"baseline_ns_per_op\": " << format_number(*result.baseline_ns_per_op)
+           << ", \"change_percent\": " << format_number(change)
+           << ", \"regression\": " << (change > tolerance_percent ? "true" : "false");
+      }
+      os << " }" << (&result != &results.back() ? "," : "") << "\n";
+    }
+    os << "  ]\n}\n";
+  }
+
+  std::optional<std::string> read_field(const std::string& line, std::string_view name) {
+    const auto key = "\"" + std::string(name) + "\": ";
+    auto begin = line.find(key);
+    if (begin == std::string::npos)
+      return std::nullopt;
+    begin += key.size();
+    if (line[begin] == '"') {
+      ++begin;
+      return line.substr(begin, line.find('"', begin) - begin);
+    }
+    return line.substr(begin, line.find_first_of(",}", begin) - begin);
+  }
+
+  bool read_baseline(const std::string& filename, std::map<std::string, double>* baseline) {
+    auto file = std::ifstream(filename);
+    if (!file.good())
+      return false;
+    auto line = std::string();
+    while (std::getline(file, line)) {
+      const auto id = read_field(line, "id");
+      const auto ns_per_op = read_field(line, "ns_per_op");
+      if (id && ns_per_op)
+        (*baseline)[*id] = std::strtod(ns_per_op->c_str(), nullptr);
+    }
+    return true;
+  }
+
+  bool interpret_commandline(Settings& settings, int argc, char* argv[]) {
+    for (auto i = 1; i < argc; i++) {
+      const auto argument = std::string_view(argv[i]);
+      const auto has_value = (i + 1 < argc);
+      if (argument == "--quick")
+        settings.quick = true;
+      else if (argument == "-v" || argument == "--verbose")
+        g_verbose_output = true;
+      else if (argument == "--filter" && has_value)
+        settings.filter = argv[++i];
+      else if ((argument == "-o" || argument == "--output") && has_value)
+        settings.output_filename = argv[++i];
+      else if (argument == "--baseline" && has_value)
+        settings.baseline_filename = argv[++i];
+      else if (argument == "--tolerance" && has_value)
+        settings.tolerance_percent = std::atof(argv[++i]);
+      else
+        return false;
+    }
+    return true;
+  }
+
+  void print_help_message() {
+    message(
+      "bench-keymapper %s\n"
+      "\n"
+      "Usage: bench-keymapper [-options]\n"
+      "  --quick              run fewer and shorter benchmarks.\n"
+      "  --filter \"string\"    only run benchmarks with the string in their id.\n"
+      "  -o, --output \"file\"  write the JSON results to a file.\n"
+      "  --baseline \"file\"    compare with the results of a previous run.\n"
+      "  --tolerance N        percentage above the baseline which counts\n"
+      "                       as regression (default 10).\n"
+      "  -v, --verbose        enable verbose output.\n"
+      "\n", about_header);
+  }
+} // namespace
+
+int main(int argc, char* argv[]) try {
+  auto settings = Settings{ };
+  if (!interpret_commandline(settings, argc, argv)) {
+    print_help_message();
+    return 1;
+  }
+
+  auto baseline = std::map<std::string, double>();
+  if (!settings.baseline_filename.empty() &&
+      !read_baseline(settings.baseline_filename, &baseline)) {
+    error("Reading baseline '%s' failed", settings.baseline_filename.c_str());
+    return 1;
+  }
+
+  auto results = std::vector<Result>();
+  auto regressions = 0;
+  const auto benchmarks = get_benchmarks(settings.quick);
+  for (const auto& benchmark : benchmarks) {
+    const auto id = get_id(benchmark);
+    if (id.find(settings.filter) == std::string::npos)
+      continue;
+    verbose("Running %s", id.c_str());
+
+    auto& result = results.emplace_back(run_benchmark(benchmark, settings.quick));
+    if (auto it = baseline.find(id); it != baseline.end()) {
+      result.baseline_ns_per_op = it->second;
+      if (result.ns_per_op > it->second * (1 + settings.tolerance_percent / 100))
+        ++regressions;
+    }
+    if (!settings.output_filename.empty())
+      message("%-60s %12.2f ns/op", id.c_str(), result.ns_per_op);
+  }
+
+  if (settings.output_filename.empty()) {
+    write_json(std::cout, results, settings.tolerance_percent);
+  }
+  else {
+    auto file = std::ofstream(settings.output_filename);
+    write_json(file, results, settings.tolerance_percent);
+    if (!file.good()) {
+      error("Writing '%s' failed", settings.output_filename.c_str());
+      return 1;
+    }
+  }
+  return (regressions ? 2 : 0);
+}
+catch (const std::exception& ex) {
+  error("%s", ex.what());
+  return 1;
+}
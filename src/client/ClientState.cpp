@@ -3,6 +3,9 @@
 #include "config/get_key_name.h"
 #include "config/ParseKeySequence.h"
 #include "common/output.h"
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
 #include <sstream>
 #include <utility>
 
@@ -43,6 +46,141 @@ namespace {
         return (action.type == Config::ActionType::toggle_active);
       });
   }
+
+  double to_milliseconds(std::chrono::nanoseconds time) {
+    return std::chrono::duration<double, std::milli>(time).count();
+  }
+
+  // lists contexts and mappings by their line in the configuration,
+  // the ones which took the most time first
+  std::string format_mapping_profile(const Config& config,
+      const std::vector<Stage::ContextProfile>& context_profiles) {
+    if (context_profiles.empty())
+      return "Profiling mappings was not started";
+
+    struct Row {
+      int line_no;
+      Stage::MatchProfile profile;
+    };
+    auto contexts = std::vector<Row>();
+    auto mappings = std::vector<Row>();
+    const auto context_count = std::min(
+      context_profiles.size(), config.contexts.size());
+    for (auto i = 0u; i < context_count; ++i) {
+      const auto& context = config.contexts[i];
+      const auto& context_profile = context_profiles[i];
+      auto total = Stage::MatchProfile{ };
+      const auto input_count = std::min(
+        context_profile.size(), context.inputs.size());
+      for (auto j = 0u; j < input_count; ++j) {
+        const auto& profile = context_profile[j];
+        if (!profile.calls)
+          continue;
+        total.calls += profile.calls;
+        total.might_matches += profile.might_matches;
+        total.matches += profile.matches;
+        total.time += profile.time;
+        mappings.push_back({ context.inputs[j].line_no, profile });
+      }
+      if (total.calls)
+        contexts.push_back({ context.line_no, total });
+    }
+    if (mappings.empty())
+      return "No mapping was matched since profiling was started";
+
+    const auto by_time = [](const Row& a, const Row& b) {
+      return a.profile.time > b.profile.time;
+    };
+    std::stable_sort(contexts.begin(), contexts.end(), by_time);
+    std::stable_sort(mappings.begin(), mappings.end(), by_time);
+
+    auto result = std::string();
+    char line[128];
+    const auto add_rows = [&](const char* title, const std::vector<Row>& rows) {
+      std::snprintf(line, sizeof(line), "%-10s %10s %12s %10s %12s\n",
+        title, "calls", "might match", "match", "time");
+      result += line;
+      for (const auto& row : rows) {
+        const auto line_no = (row.line_no ?
+          "line " + std::to_string(row.line_no) : std::string("-"));
+        std::snprintf(line, sizeof(line), "%-10s %10llu %12llu %10llu %10.3fms\n",
+          line_no.c_str(),
+          static_cast<unsigned long long>(row.profile.calls),
+          static_cast<unsigned long long>(row.profile.might_matches),
+          static_cast<unsigned long long>(row.profile.matches),
+          to_milliseconds(row.profile.time));
+        result += line;
+      }
+    };
+    add_rows("context", contexts);
+    add_rows("mapping", mappings);
+    result.pop_back();
+    return result;
+  }
+
+  // Chrome trace JSON, which can be viewed e.g. in Perfetto
+  std::string format_chrome_trace(const Config& config,
+      const std::vector<TraceRecord>& records) {
+    // stages begin with the first context and every begin_stage context
+    auto stage_offsets = std::vector<size_t>();
+    for (auto i = 0u; i < config.contexts.size(); ++i)
+      if (i == 0 || config.contexts[i].begin_stage)
+        stage_offsets.push_back(i);
+
+    const auto get_line_no = [&](const TraceRecord& record) {
+      if (record.stage_index < 0 ||
+          static_cast<size_t>(record.stage_index) >= stage_offsets.size() ||
+          record.context_index < 0 || record.input_index < 0)
+        return 0;
+      const auto context_index = 
+        stage_offsets[record.stage_index] + record.context_index;
+      if (context_index >= config.contexts.size())
+        return 0;
+      const auto& inputs = config.contexts[context_index].inputs;
+      if (static_cast<size_t>(record.input_index) >= inputs.size())
+        return 0;
+      return inputs[record.input_index].line_no;
+    };
+
+    const auto format_event = [](const KeyEvent& event) {
+      auto string = std::string(event.state == KeyState::Down ? "+" :
+                                event.state == KeyState::Up ? "-" : "*");
+      if (auto key_name = get_key_name(event.key))
+        return string + key_name;
+      return string + std::to_string(*event.key);
+    };
+
+    const auto to_microseconds = [](auto duration) {
+      return std::chrono::duration<double, std::micro>(duration).count();
+    };
+
+    auto ss = std::stringstream();
+    ss << "{\"traceEvents\":[";
+    for (const auto& record : records) {
+      ss << (&record == records.data() ? "\n" : ",\n");
+      ss << "{\"ph\":\"X\",\"pid\":1,\"tid\":1,\"name\":\"";
+      switch (record.type) {
+        case TraceRecord::Type::translate_input: ss << "translate_input"; break;
+        case TraceRecord::Type::stage_update: ss << "stage_update"; break;
+        case TraceRecord::Type::flush: ss << "flush"; break;
+      }
+      ss << "\",\"ts\":" << std::fixed << std::setprecision(3)
+         << to_microseconds(record.begin - records.front().begin)
+         << ",\"dur\":" << to_microseconds(record.duration)
+         << ",\"args\":{";
+      if (record.type != TraceRecord::Type::flush)
+        ss << "\"event\":\"" << format_event(record.event) << "\","
+           << "\"device\":" << record.device_index << ",";
+      if (record.type == TraceRecord::Type::stage_update) {
+        ss << "\"stage\":" << static_cast<int>(record.stage_index) << ",";
+        if (const auto line_no = get_line_no(record))
+          ss << "\"line\":" << line_no << ",";
+      }
+      ss << "\"outputs\":" << record.output_count << "}}";
+    }
+    ss << "\n],\"displayTimeUnit\":\"ns\"}\n";
+    return ss.str();
+  }
 } // namespace
 
 void ClientState::execute_action(const Config::Action& action) {
@@ -139,11 +277,24 @@ bool ClientState::update_config(bool check_modified) {
   return true;
 }
 
+bool ClientState::update_config_in_background(bool check_modified) {
+  if (!m_config_file.update_in_background(check_modified))
+    return false;
+  notify("Configuration updated");
+  return true;
+}
+
+bool ClientState::is_updating_config() const {
+  return m_config_file.updating_in_background();
+}
+
 const Config& ClientState::config() const {
   return m_config_file.config();
 }
 
 bool ClientState::send_config() {
+  m_context_matcher.set_contexts(m_config_file.config().contexts);
+
   verbose("Sending configuration");
   if (!m_server.send_config(m_config_file.config())) {
     error("Sending configuration failed");
@@ -203,14 +354,10 @@ bool ClientState::update_active_contexts(bool force) {
       return false;
   }
 
-  m_new_active_contexts.clear();
-  const auto& contexts = m_config_file.config().contexts;
-  for (auto i = 0; i < static_cast<int>(contexts.size()); ++i)
-    if (contexts[i].matches(
-        m_focused_window.window_class(),
-        m_focused_window.window_title(),
-        m_focused_window.window_path()))
-      m_new_active_contexts.push_back(i);
+  m_new_active_contexts = m_context_matcher.match(
+    m_focused_window.window_class(),
+    m_focused_window.window_title(),
+    m_focused_window.window_path());
 
   if (m_new_active_contexts != m_active_contexts) {
     verbose("Active contexts updated");
@@ -220,6 +367,27 @@ bool ClientState::update_active_contexts(bool force) {
   return false;
 }
 
+#if !defined(_WIN32)
+bool ClientState::get_wait_fds(std::vector<int>* fds) const {
+  if (m_server.socket() != invalid_socket)
+    fds->push_back(m_server.socket());
+  m_control.get_wait_sockets(fds);
+  // focused window is only updated while active
+  if (!m_active)
+    return true;
+  return m_focused_window.get_wait_fds(fds);
+}
+
+bool ClientState::get_config_wait_fds(std::vector<int>* fds) const {
+  // poll until parsing in background completed
+  const auto fd = m_config_file.wait_fd();
+  if (fd < 0 || is_updating_config())
+    return false;
+  fds->push_back(fd);
+  return true;
+}
+#endif
+
 bool ClientState::send_active_contexts() {
   verbose("Sending active contexts (%u)", m_active_contexts.size());
   return m_server.send_active_contexts(m_active_contexts);
@@ -275,6 +443,36 @@ void ClientState::request_next_key_info() {
   m_server.send_request_next_key_info();
 }
 
+void ClientState::on_statistics_message(const std::string& statistics) {
+  if (!m_control.reply_statistics(statistics))
+    message("%s", statistics.c_str());
+}
+
+void ClientState::on_statistics_requested_message() {
+  m_server.send_request_statistics();
+}
+
+void ClientState::on_mapping_profile_message(
+    const std::vector<Stage::ContextProfile>& context_profiles) {
+  const auto report = format_mapping_profile(config(), context_profiles);
+  if (!m_control.reply_mapping_profile(report))
+    message("%s", report.c_str());
+}
+
+void ClientState::on_mapping_profile_requested_message(bool start) {
+  m_server.send_request_mapping_profile(start);
+}
+
+void ClientState::on_trace_message(const std::vector<TraceRecord>& records) {
+  const auto json = format_chrome_trace(config(), records);
+  if (!m_control.reply_trace(json))
+    message("%s", json.c_str());
+}
+
+void ClientState::on_trace_requested_message(bool start) {
+  m_server.send_request_trace(start);
+}
+
 bool ClientState::on_inject_input_message(const std::string& string) try {
   static auto s_parse_sequence = ParseKeySequence();
   const auto sequence = ensure_all_keys_up(
@@ -4,6 +4,7 @@
 #include "client/ConfigFile.h"
 #include "client/ServerPort.h"
 #include "client/ControlPort.h"
+#include "config/ContextMatcher.h"
 
 class ClientState : public ServerPort::MessageHandler,
                     public ControlPort::MessageHandler {
@@ -14,6 +15,8 @@ public:
 
   bool load_config(std::filesystem::path filename);
   bool update_config(bool check_modified);
+  bool update_config_in_background(bool check_modified);
+  bool is_updating_config() const;
   const Config& config() const;
   std::optional<Socket> connect_server();
   bool read_server_messages(std::optional<Duration> timeout = { });
@@ -29,17 +32,29 @@ public:
   std::optional<Socket> accept_control_connection();
   void read_control_messages();
   void request_next_key_info();
+#if !defined(_WIN32)
+  // returns false when some changes can only be detected by polling
+  bool get_wait_fds(std::vector<int>* fds) const;
+  bool get_config_wait_fds(std::vector<int>* fds) const;
+#endif
 
 protected:
   // server messages
   void on_execute_action_message(int triggered_action) override;
   void on_virtual_key_state_message(Key key, KeyState state) override;
   void on_next_key_info_message(const std::vector<Key>& keys, DeviceDesc device) override;
+  void on_statistics_message(const std::string& statistics) override;
+  void on_mapping_profile_message(
+    const std::vector<Stage::ContextProfile>& context_profiles) override;
+  void on_trace_message(const std::vector<TraceRecord>& records) override;
 
   // control messages
   void on_set_virtual_key_state_message(Key key, KeyState state) override;
   bool on_set_config_file_message(std::string filename) override;
   void on_next_key_info_requested_message() override;
+  void on_statistics_requested_message() override;
+  void on_mapping_profile_requested_message(bool start) override;
+  void on_trace_requested_message(bool start) override;
   bool on_inject_input_message(const std::string& string) override;
   bool on_inject_output_message(const std::string& string) override;
   bool on_inject_output_message(KeyEvent event) override;
@@ -56,6 +71,7 @@ private:
   ServerPort m_server;
   ControlPort m_control;
   FocusedWindow m_focused_window;
+  ContextMatcher m_context_matcher;
   std::vector<int> m_active_contexts;
   std::vector<int> m_new_active_contexts;
   bool m_active{ true };
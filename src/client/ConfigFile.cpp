@@ -5,6 +5,7 @@
 #include <cstdio>
 #include <fstream>
 #include <thread>
+#include <utility>
 
 #if defined(_WIN32)
 
@@ -31,6 +32,13 @@ namespace {
 
 #include <sys/stat.h>
 
+#if defined(__linux__)
+# include <sys/inotify.h>
+# include <unistd.h>
+# include <algorithm>
+# include <utility>
+#endif
+
 namespace {
   std::time_t get_modify_time(const std::string& filename) {
     using stat_t = struct stat;
@@ -44,6 +52,10 @@ namespace {
 #endif // !defined(_WIN32)
 
 namespace {
+  // do not reload too quickly after a modification was detected
+  // at least saving with gedit resulted in reading an empty configuration
+  const auto modification_settle_time = std::chrono::milliseconds(250);
+
   std::time_t get_latest_modify_time(const std::filesystem::path& filename, 
       const std::vector<std::filesystem::path>& include_filenames) {
     auto time = get_modify_time(filename);
@@ -55,39 +67,229 @@ namespace {
   }
 } // namespace
 
+#if defined(__linux__)
+
+ConfigFile::Notify::Notify(Notify&& rhs) noexcept
+  : fd(std::exchange(rhs.fd, -1)),
+    watches(std::move(rhs.watches)),
+    directories(std::move(rhs.directories)),
+    filenames(std::move(rhs.filenames)) {
+}
+
+ConfigFile::Notify& ConfigFile::Notify::operator=(Notify&& rhs) noexcept {
+  auto tmp = std::move(rhs);
+  std::swap(fd, tmp.fd);
+  std::swap(watches, tmp.watches);
+  std::swap(directories, tmp.directories);
+  std::swap(filenames, tmp.filenames);
+  return *this;
+}
+
+ConfigFile::Notify::~Notify() {
+  if (fd >= 0)
+    ::close(fd);
+}
+
+void ConfigFile::update_watches() {
+  if (m_notify.fd < 0)
+    m_notify.fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m_notify.fd < 0)
+    return;
+
+  auto previous_watches = std::move(m_notify.watches);
+  m_notify.watches.clear();
+  m_notify.directories.clear();
+  m_notify.filenames.clear();
+
+  // also watch the targets of symlinks
+  auto error = std::error_code{ };
+  const auto add_filename = [&](const std::filesystem::path& filename) {
+    m_notify.filenames.push_back(filename.lexically_normal());
+    auto target = std::filesystem::weakly_canonical(filename, error);
+    if (!error && target != m_notify.filenames.back())
+      m_notify.filenames.push_back(std::move(target));
+  };
+  add_filename(m_filename);
+  for (const auto& include_filename : m_config->include_filenames)
+    add_filename(include_filename);
+
+  // editors saving atomically write a new file and rename it.
+  // watching a directory again returns the same descriptor, so
+  // notifications which are already queued are still recognized
+  for (const auto& filename : m_notify.filenames) {
+    const auto& directory = filename.parent_path();
+    if (std::count(m_notify.directories.begin(), 
+          m_notify.directories.end(), directory))
+      continue;
+    const auto watch = ::inotify_add_watch(m_notify.fd, directory.c_str(), 
+      IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (watch >= 0) {
+      m_notify.watches.push_back(watch);
+      m_notify.directories.push_back(directory);
+    }
+  }
+
+  // only stop watching directories which are no longer needed
+  for (auto watch : previous_watches)
+    if (!std::count(m_notify.watches.begin(), m_notify.watches.end(), watch))
+      ::inotify_rm_watch(m_notify.fd, watch);
+}
+
+bool ConfigFile::read_notifications() {
+  auto modified = false;
+  alignas(inotify_event) char buffer[4096];
+  for (;;) {
+    const auto size = ::read(m_notify.fd, buffer, sizeof(buffer));
+    if (size <= 0)
+      break;
+    for (auto it = buffer; it < buffer + size; ) {
+      const auto& event = *reinterpret_cast<const inotify_event*>(it);
+      it += sizeof(inotify_event) + event.len;
+
+      const auto watch = std::find(m_notify.watches.begin(), 
+        m_notify.watches.end(), event.wd);
+      if (watch == m_notify.watches.end() || !event.len)
+        continue;
+      const auto& directory = m_notify.directories[static_cast<size_t>(
+        std::distance(m_notify.watches.begin(), watch))];
+      if (std::count(m_notify.filenames.begin(), m_notify.filenames.end(),
+            directory / event.name))
+        modified = true;
+    }
+  }
+  return modified;
+}
+
+int ConfigFile::wait_fd() const {
+  return (m_notify.watches.empty() ? -1 : m_notify.fd);
+}
+
+#elif !defined(_WIN32)
+
+int ConfigFile::wait_fd() const {
+  return -1;
+}
+
+#endif // !defined(_WIN32)
+
+ConfigFile::Worker& ConfigFile::Worker::operator=(Worker&& rhs) noexcept {
+  if (this != &rhs) {
+    if (thread.joinable())
+      thread.join();
+    thread = std::move(rhs.thread);
+  }
+  return *this;
+}
+
+ConfigFile::Worker::~Worker() {
+  if (thread.joinable())
+    thread.join();
+}
+
 bool ConfigFile::load(std::filesystem::path filename) {
   m_filename = std::move(filename);
   m_modify_time = { -1 };
-  return update();
+  m_modification_detected.reset();
+  return update(false);
 }
 
-bool ConfigFile::update(bool check_modified) {
+bool ConfigFile::is_modified() {
+  if (std::exchange(m_modification_pending, false))
+    return true;
+
+#if defined(__linux__)
+  // files were closed after writing, no need to wait
+  if (wait_fd() >= 0)
+    return read_notifications();
+#endif
+
   const auto modify_time = get_latest_modify_time(
-    m_filename, m_config.include_filenames);
-  if (check_modified && 
-      modify_time == m_modify_time)
+    m_filename, m_config->include_filenames);
+  if (modify_time == m_modify_time) {
+    m_modification_detected.reset();
     return false;
-  try {
-    // do not reload too quickly after a modification was detected
-    // at least saving with gedit resulted in reading an empty configuration
-    if (check_modified && !m_config.contexts.empty())
-      std::this_thread::sleep_for(std::chrono::milliseconds(250));
-  
-    m_modify_time = get_latest_modify_time(
-      m_filename, m_config.include_filenames);
+  }
+
+  const auto now = Clock::now();
+  if (!m_modification_detected)
+    m_modification_detected = now;
+  return (now - *m_modification_detected >= modification_settle_time);
+}
 
-    auto is = std::ifstream(m_filename);
+ConfigFile::ParseResult ConfigFile::parse(
+    const std::filesystem::path& filename) {
+  auto result = ParseResult{ };
+  try {
+    auto is = std::ifstream(filename);
     if (is.good()) {
       auto parse = ParseConfig();
-      m_config = parse(is, m_filename.parent_path());
-      return true;
+      result.config = std::make_shared<const Config>(
+        parse(is, filename.parent_path()));
     }
     else {
-      error("Opening configuration file failed '%s'", m_filename.c_str());
+      result.error = "Opening configuration file failed '" + 
+        filename.string() + "'";
     }
   }
   catch (const std::exception& ex) {
-    error("%s", ex.what());
+    result.error = ex.what();
   }
-  return false;
+  return result;
+}
+
+bool ConfigFile::apply(ParseResult result) {
+  if (!result.config)
+    error("%s", result.error.c_str());
+  else
+    m_config = std::move(result.config);
+
+#if defined(__linux__)
+  // includes might have changed, also keep watching after failure
+  update_watches();
+#endif
+  return (result.error.empty());
+}
+
+bool ConfigFile::update(bool check_modified) {
+  // discard pending update in background, without waiting for the worker.
+  // the modification it was started for is detected again
+  if (m_parsing.valid()) {
+    m_parsing = { };
+    m_modification_pending = true;
+  }
+
+  if (check_modified && !is_modified())
+    return false;
+  m_modification_detected.reset();
+  m_modification_pending = false;
+  m_modify_time = get_latest_modify_time(
+    m_filename, m_config->include_filenames);
+  return apply(parse(m_filename));
+}
+
+bool ConfigFile::update_in_background(bool check_modified) {
+  if (!m_parsing.valid()) {
+    if (check_modified && !is_modified())
+      return false;
+    m_modification_detected.reset();
+    m_modify_time = get_latest_modify_time(
+      m_filename, m_config->include_filenames);
+    // not std::async, since its future would block until parsing
+    // finished when a pending update is discarded. the worker of a 
+    // discarded update is joined when it is replaced
+    auto promise = std::promise<ParseResult>();
+    m_parsing = promise.get_future();
+    auto worker = Worker();
+    worker.thread = std::thread(
+      [promise = std::move(promise), filename = m_filename]() mutable {
+        promise.set_value(parse(filename));
+      });
+    m_worker = std::move(worker);
+    return false;
+  }
+
+  if (m_parsing.wait_for(std::chrono::seconds::zero()) != 
+        std::future_status::ready)
+    return false;
+  return apply(m_parsing.get());
 }
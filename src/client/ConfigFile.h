@@ -1,20 +1,76 @@
 #pragma once
 
 #include "config/Config.h"
+#include "common/Duration.h"
 #include <ctime>
 #include <string>
 #include <filesystem>
+#include <optional>
+#include <future>
+#include <memory>
+#include <thread>
 
 class ConfigFile {
 public:
   bool load(std::filesystem::path filename);
   bool update(bool check_modified = true);
-  const Config& config() const { return m_config; }
+  // parses on a worker thread, returns true once the configuration was updated
+  bool update_in_background(bool check_modified = true);
+  bool updating_in_background() const { return m_parsing.valid(); }
+  const Config& config() const { return *m_config; }
   const std::filesystem::path& filename() const { return m_filename; }
   explicit operator bool() const { return !m_filename.empty(); }
+#if !defined(_WIN32)
+  // readable when the file might have been modified, -1 when it has to be polled
+  int wait_fd() const;
+#endif
 
 private:
+  struct ParseResult {
+    std::shared_ptr<const Config> config;
+    std::string error;
+  };
+
+  // joins the thread before it is replaced or destroyed
+  struct Worker {
+    std::thread thread;
+
+    Worker() = default;
+    Worker(Worker&& rhs) noexcept = default;
+    Worker& operator=(Worker&& rhs) noexcept;
+    ~Worker();
+  };
+
+  static ParseResult parse(const std::filesystem::path& filename);
+  bool apply(ParseResult result);
+
+#if defined(__linux__)
+  struct Notify {
+    int fd{ -1 };
+    // watch descriptors of the directories containing the files
+    std::vector<int> watches;
+    std::vector<std::filesystem::path> directories;
+    std::vector<std::filesystem::path> filenames;
+
+    Notify() = default;
+    Notify(Notify&& rhs) noexcept;
+    Notify& operator=(Notify&& rhs) noexcept;
+    ~Notify();
+  };
+
+  void update_watches();
+  bool read_notifications();
+  Notify m_notify;
+#endif
+
+  bool is_modified();
+
   std::filesystem::path m_filename;
   std::time_t m_modify_time{ -1 };
-  Config m_config;
+  std::optional<Clock::time_point> m_modification_detected;
+  // a discarded update in background was not applied yet
+  bool m_modification_pending{ };
+  std::shared_ptr<const Config> m_config{ std::make_shared<const Config>() };
+  std::future<ParseResult> m_parsing;
+  Worker m_worker;
 };
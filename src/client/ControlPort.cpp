@@ -151,6 +151,13 @@ void ControlPort::read_messages(MessageHandler& handler) {
   }
 }
 
+void ControlPort::get_wait_sockets(std::vector<Socket>* sockets) const {
+  if (m_host.listen_socket() != invalid_socket)
+    sockets->push_back(m_host.listen_socket());
+  for (const auto& [socket, control] : m_controls)
+    sockets->push_back(socket);
+}
+
 void ControlPort::on_next_key_info_requested(Connection& connection) {
   if (auto control = get_control(connection))
     control->requested_next_key_info = true;
@@ -169,6 +176,60 @@ bool ControlPort::reply_next_key_info(const std::string& key_info) {
   return requested;
 }
 
+void ControlPort::on_statistics_requested(Connection& connection) {
+  if (auto control = get_control(connection))
+    control->requested_statistics = true;
+}
+
+bool ControlPort::reply_statistics(const std::string& statistics) {
+  auto requested = false;
+  for (auto& [socket, control] : m_controls)
+    if (std::exchange(control.requested_statistics, false)) {
+      control.connection.send_message([&](Serializer& s) {
+        s.write(MessageType::statistics);
+        s.write(statistics);
+      });
+      requested = true;
+    }
+  return requested;
+}
+
+void ControlPort::on_mapping_profile_requested(Connection& connection) {
+  if (auto control = get_control(connection))
+    control->requested_mapping_profile = true;
+}
+
+bool ControlPort::reply_mapping_profile(const std::string& report) {
+  auto requested = false;
+  for (auto& [socket, control] : m_controls)
+    if (std::exchange(control.requested_mapping_profile, false)) {
+      control.connection.send_message([&](Serializer& s) {
+        s.write(MessageType::mapping_profile);
+        s.write(report);
+      });
+      requested = true;
+    }
+  return requested;
+}
+
+void ControlPort::on_trace_requested(Connection& connection) {
+  if (auto control = get_control(connection))
+    control->requested_trace = true;
+}
+
+bool ControlPort::reply_trace(const std::string& json) {
+  auto requested = false;
+  for (auto& [socket, control] : m_controls)
+    if (std::exchange(control.requested_trace, false)) {
+      control.connection.send_message([&](Serializer& s) {
+        s.write(MessageType::trace);
+        s.write(json);
+      });
+      requested = true;
+    }
+  return requested;
+}
+
 bool ControlPort::read_messages(Connection& connection, 
     MessageHandler& handler) {
   return connection.read_messages(Duration::zero(), 
@@ -219,6 +280,21 @@ bool ControlPort::read_messages(Connection& connection,
           handler.on_next_key_info_requested_message();
           break;
         }
+        case MessageType::statistics: {
+          on_statistics_requested(connection);
+          handler.on_statistics_requested_message();
+          break;
+        }
+        case MessageType::mapping_profile: {
+          on_mapping_profile_requested(connection);
+          handler.on_mapping_profile_requested_message(d.read<bool>());
+          break;
+        }
+        case MessageType::trace: {
+          on_trace_requested(connection);
+          handler.on_trace_requested_message(d.read<bool>());
+          break;
+        }
         case MessageType::inject_input: {
           send_result(handler.on_inject_input_message(d.read_string()));
           break;
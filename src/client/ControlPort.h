@@ -18,17 +18,24 @@ public:
   void set_virtual_key_aliases(std::vector<std::pair<std::string, Key>> aliases);
   void on_virtual_key_state_changed(Key key, KeyState state);
   bool reply_next_key_info(const std::string& key_info);
+  bool reply_statistics(const std::string& statistics);
+  bool reply_mapping_profile(const std::string& report);
+  bool reply_trace(const std::string& json);
 
   struct MessageHandler {
     virtual void on_set_virtual_key_state_message(Key key, KeyState state) = 0;
     virtual bool on_set_config_file_message(std::string filename) = 0;
     virtual void on_next_key_info_requested_message() = 0;
+    virtual void on_statistics_requested_message() = 0;
+    virtual void on_mapping_profile_requested_message(bool start) = 0;
+    virtual void on_trace_requested_message(bool start) = 0;
     virtual bool on_inject_input_message(const std::string& string) = 0;
     virtual bool on_inject_output_message(const std::string& string) = 0;
     virtual bool on_inject_output_message(KeyEvent event) = 0;
     virtual bool on_notify_message(const std::string& string) = 0;
   };
   void read_messages(MessageHandler& handler);
+  void get_wait_sockets(std::vector<Socket>* sockets) const;
 
 private:
   struct Control {
@@ -36,6 +43,9 @@ private:
     std::string instance_id;
     Key requested_virtual_key_toggle_notification{ };
     bool requested_next_key_info{ };
+    bool requested_statistics{ };
+    bool requested_mapping_profile{ };
+    bool requested_trace{ };
   };
 
   Control* get_control(const Connection& connection);
@@ -49,6 +59,9 @@ private:
   void on_virtual_key_toggle_notification_requested(
     Connection& connection, Key key);
   void on_next_key_info_requested(Connection& connection);
+  void on_statistics_requested(Connection& connection);
+  void on_mapping_profile_requested(Connection& connection);
+  void on_trace_requested(Connection& connection);
   void on_set_instance_id(Connection& connection, std::string id);
   void disconnect_by_instance_id(const std::string& id);
 
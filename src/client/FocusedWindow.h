@@ -2,6 +2,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 class FocusedWindow {
 public:
@@ -17,6 +18,11 @@ public:
   const std::string& window_title() const;
   const std::string& window_path() const;
   bool is_inaccessible() const;
+#if !defined(_WIN32)
+  // file descriptors, which become readable when the focus might have 
+  // changed. returns false when changes can only be detected by polling
+  bool get_wait_fds(std::vector<int>* fds) const;
+#endif
 
 private:
   std::unique_ptr<class FocusedWindowImpl> m_impl;
@@ -1,12 +1,48 @@
 
 #include "ServerPort.h"
 #include "common/MessageType.h"
+#include <algorithm>
+#include <iterator>
+
+#if defined(__linux__)
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <unistd.h>
+#endif
 
 namespace {
-  void write_key_sequence(Serializer& s, const KeySequence& sequence) {
-    s.write(static_cast<uint32_t>(sequence.size()));
-    for (const auto& event : sequence)
-      s.write(event);
+  void write_count(Serializer& s, uint8_t encoding, size_t count) {
+    if (encoding == configuration_encoding_fixed_width)
+      s.write(static_cast<uint32_t>(count));
+    else
+      s.write_varint(count);
+  }
+
+  void write_index(Serializer& s, uint8_t encoding, int index) {
+    if (encoding == configuration_encoding_fixed_width)
+      s.write(static_cast<int32_t>(index));
+    else
+      s.write_signed_varint(index);
+  }
+
+  // keys are encoded as difference to the previous key,
+  // followed by the state in the lowest 4 bits of the value
+  void write_key_sequence(Serializer& s, uint8_t encoding, 
+      const KeySequence& sequence) {
+    write_count(s, encoding, sequence.size());
+    if (encoding == configuration_encoding_fixed_width) {
+      for (const auto& event : sequence)
+        s.write(event);
+      return;
+    }
+    auto prev_key = 0;
+    for (const auto& event : sequence) {
+      const auto key = static_cast<int>(*event.key);
+      s.write_signed_varint(key - prev_key);
+      s.write_varint(static_cast<uint32_t>(event.value) << 4 | 
+        static_cast<uint32_t>(event.state));
+      prev_key = key;
+    }
   }
   
   void write_filter(Serializer& s, const Filter& filter) {
@@ -14,30 +50,30 @@ namespace {
     s.write(filter.invert);
   }
 
-  void write_contexts(Serializer& s, 
+  void write_contexts(Serializer& s, uint8_t encoding,
       const std::vector<Config::Context>& contexts) {
-    s.write(static_cast<uint32_t>(contexts.size()));
+    write_count(s, encoding, contexts.size());
     for (const auto& context : contexts) {
       // begin stage
       s.write(context.begin_stage);
 
       // inputs
-      s.write(static_cast<uint32_t>(context.inputs.size()));
+      write_count(s, encoding, context.inputs.size());
       for (const auto& input : context.inputs) {
-        write_key_sequence(s, input.input);
-        s.write(static_cast<int32_t>(input.output_index));
+        write_key_sequence(s, encoding, input.input);
+        write_index(s, encoding, input.output_index);
       }
 
       // outputs
-      s.write(static_cast<uint32_t>(context.outputs.size()));
+      write_count(s, encoding, context.outputs.size());
       for (const auto& output : context.outputs)
-        write_key_sequence(s, output);
+        write_key_sequence(s, encoding, output);
 
       // command outputs
-      s.write(static_cast<uint32_t>(context.command_outputs.size()));
+      write_count(s, encoding, context.command_outputs.size());
       for (const auto& command : context.command_outputs) {
-        write_key_sequence(s, command.output);
-        s.write(static_cast<int32_t>(command.index));
+        write_key_sequence(s, encoding, command.output);
+        write_index(s, encoding, command.index);
       }
 
       // device filter
@@ -47,7 +83,7 @@ namespace {
       write_filter(s, context.device_id_filter);
       
       // modifier filter
-      write_key_sequence(s, context.modifier_filter);
+      write_key_sequence(s, encoding, context.modifier_filter);
       s.write(context.invert_modifier_filter);
 
       // fallthrough
@@ -55,35 +91,78 @@ namespace {
     }
   }
 
-  void write_grab_device_filters(Serializer& s, 
+  void write_grab_device_filters(Serializer& s, uint8_t encoding,
       const std::vector<GrabDeviceFilter>& device_filters) {
-    s.write(static_cast<uint32_t>(device_filters.size()));
+    write_count(s, encoding, device_filters.size());
     for (const auto& device_filter : device_filters) {
       write_filter(s, device_filter);
       s.write(device_filter.by_id);
     }
   }
 
-  void write_directives(Serializer& s,
+  void write_directives(Serializer& s, uint8_t encoding,
       const std::vector<std::string>& directives) {
-    s.write(static_cast<uint32_t>(directives.size()));
+    write_count(s, encoding, directives.size());
     for (const auto& directive : directives)
       s.write(directive);
   }
 
   void write_active_contexts(Serializer& s, const std::vector<int>& indices) {
-    s.write(static_cast<uint32_t>(indices.size()));
+    s.write_varint(indices.size());
     for (const auto& index : indices)
-      s.write(static_cast<uint32_t>(index));
+      s.write_varint(static_cast<uint32_t>(index));
+  }
+
+#if defined(__linux__)
+  // smaller configurations are sent through the socket
+  const auto shared_config_min_size = size_t{ 64 * 1024 };
+
+  int create_sealed_memfd(const std::vector<char>& data) {
+    const auto fd = ::memfd_create("keymapper-config", 
+      MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+      return -1;
+
+    auto written = size_t{ };
+    while (written < data.size()) {
+      const auto result = ::write(fd, data.data() + written, 
+        data.size() - written);
+      if (result == -1 && errno == EINTR)
+        continue;
+      if (result <= 0)
+        break;
+      written += static_cast<size_t>(result);
+    }
+
+    // prevent modification while keymapperd is reading
+    if (written != data.size() ||
+        ::fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | 
+          F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+      ::close(fd);
+      return -1;
+    }
+    return fd;
+  }
+#endif
+
+  // FNV-1a
+  uint64_t get_hash(const std::vector<char>& data) {
+    auto hash = uint64_t{ 14695981039346656037ull };
+    for (auto c : data) {
+      hash ^= static_cast<uint8_t>(c);
+      hash *= uint64_t{ 1099511628211ull };
+    }
+    return hash;
   }
 } // namespace
 
-ServerPort::ServerPort() 
-  : m_host("keymapper") {
+ServerPort::ServerPort(std::string ipc_id) 
+  : m_host(std::move(ipc_id)) {
 }
 
 bool ServerPort::connect() {
   m_connection = m_host.connect();
+  m_sent_active_contexts.reset();
   return static_cast<bool>(m_connection);
 }
 
@@ -91,16 +170,71 @@ void ServerPort::disconnect() {
   m_connection.disconnect();
 }
 
-bool ServerPort::send_config(const Config& config) {
+bool ServerPort::send_config(const Config& config, uint8_t encoding) {
+  // only send hash, keymapperd requests unknown configurations
+  auto s = Serializer();
+  s.write(encoding);
+  write_grab_device_filters(s, encoding, config.grab_device_filters);    
+  write_contexts(s, encoding, config.contexts);
+  write_directives(s, encoding, config.server_directives);
+  m_config = std::move(s);
+  m_config_hash = get_hash(m_config.data());
+  m_sent_active_contexts.reset();
+
+  // keymapperd identifies configurations by their hash and size
+  return m_connection.send_message([&](Serializer& s) {
+    s.write(MessageType::configuration_hash);
+    s.write(m_config_hash);
+    s.write(static_cast<uint64_t>(m_config.data().size()));
+  });
+}
+
+bool ServerPort::send_serialized_config(bool allow_shared) {
+#if defined(__linux__)
+  // pass large configurations in shared memory, fall back to socket
+  if (allow_shared && m_config.data().size() >= shared_config_min_size) {
+    const auto fd = create_sealed_memfd(m_config.data());
+    if (fd >= 0) {
+      const auto succeeded = m_connection.send_message([&](Serializer& s) {
+        s.write(MessageType::shared_configuration);
+        s.write(m_config_hash);
+        s.write(static_cast<uint64_t>(m_config.data().size()));
+      }, fd);
+      ::close(fd);
+      return succeeded;
+    }
+  }
+#endif
+
   return m_connection.send_message([&](Serializer& s) {
     s.write(MessageType::configuration);
-    write_grab_device_filters(s, config.grab_device_filters);    
-    write_contexts(s, config.contexts);
-    write_directives(s, config.server_directives);
+    s.write(m_config_hash);
+    s.write(static_cast<uint64_t>(m_config.data().size()));
+    s.write(m_config.data().data(), m_config.data().size());
   });
 }
 
 bool ServerPort::send_active_contexts(const std::vector<int>& indices) {
+  // send only the changes, when they are fewer
+  if (m_sent_active_contexts) {
+    const auto& sent = *m_sent_active_contexts;
+    m_removed_contexts.clear();
+    m_added_contexts.clear();
+    std::set_difference(sent.begin(), sent.end(), indices.begin(), indices.end(),
+      std::back_inserter(m_removed_contexts));
+    std::set_difference(indices.begin(), indices.end(), sent.begin(), sent.end(),
+      std::back_inserter(m_added_contexts));
+    if (m_removed_contexts.size() + m_added_contexts.size() < indices.size()) {
+      m_sent_active_contexts = indices;
+      return m_connection.send_message([&](Serializer& s) {
+        s.write(MessageType::active_contexts_delta);
+        write_active_contexts(s, m_removed_contexts);
+        write_active_contexts(s, m_added_contexts);
+      });
+    }
+  }
+
+  m_sent_active_contexts = indices;
   return m_connection.send_message([&](Serializer& s) {
     s.write(MessageType::active_contexts);
     write_active_contexts(s, indices);
@@ -127,25 +261,55 @@ bool ServerPort::send_request_next_key_info() {
   });
 }
 
+bool ServerPort::send_request_statistics() {
+  return m_connection.send_message([&](Serializer& s) {
+    s.write(MessageType::statistics);
+  });
+}
+
+bool ServerPort::send_request_mapping_profile(bool start) {
+  return m_connection.send_message([&](Serializer& s) {
+    s.write(MessageType::mapping_profile);
+    s.write(start);
+  });
+}
+
+bool ServerPort::send_request_trace(bool start) {
+  return m_connection.send_message([&](Serializer& s) {
+    s.write(MessageType::trace);
+    s.write(start);
+  });
+}
+
 bool ServerPort::send_inject_input(const KeySequence& sequence) {
   return m_connection.send_message([&](Serializer& s) {
     s.write(MessageType::inject_input);
-    write_key_sequence(s, sequence);
+    write_key_sequence(s, configuration_encoding, sequence);
   });
 }
 
 bool ServerPort::send_inject_output(const KeySequence& sequence) {
   return m_connection.send_message([&](Serializer& s) {
     s.write(MessageType::inject_output);
-    write_key_sequence(s, sequence);
+    write_key_sequence(s, configuration_encoding, sequence);
   });
 }
 
 bool ServerPort::read_messages(MessageHandler& handler,
     std::optional<Duration> timeout) {
+  auto succeeded = true;
   return m_connection.read_messages(timeout,
     [&](Deserializer& d) {
       switch (d.read<MessageType>()) {
+        case MessageType::request_configuration: {
+          // ignore requests for configurations which were replaced
+          const auto hash = d.read<uint64_t>();
+          const auto size = d.read<uint64_t>();
+          const auto allow_shared = d.read<bool>();
+          if (hash == m_config_hash && size == m_config.data().size())
+            succeeded &= send_serialized_config(allow_shared);
+          break;
+        }
         case MessageType::execute_action: {
           handler.on_execute_action_message(
             static_cast<int>(d.read<uint32_t>()));
@@ -163,7 +327,23 @@ bool ServerPort::read_messages(MessageHandler& handler,
           handler.on_next_key_info_message(keys, std::move(device_desc));
           break;
         }
+        case MessageType::statistics: {
+          handler.on_statistics_message(d.read_string());
+          break;
+        }
+        case MessageType::mapping_profile: {
+          auto context_profiles = std::vector<Stage::ContextProfile>();
+          context_profiles.resize(d.read<uint32_t>());
+          for (auto& context_profile : context_profiles)
+            context_profile = d.read_vector<Stage::MatchProfile>();
+          handler.on_mapping_profile_message(context_profiles);
+          break;
+        }
+        case MessageType::trace: {
+          handler.on_trace_message(d.read_vector<TraceRecord>());
+          break;
+        }
         default: break;
       }
-    });
+    }) && succeeded;
 }
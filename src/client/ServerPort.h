@@ -4,19 +4,24 @@
 #include "common/MessageType.h"
 #include "config/Config.h"
 #include "common/DeviceDesc.h"
+#include "runtime/Stage.h"
 #include <memory>
 
 class ServerPort {
 public:
-  ServerPort();
+  explicit ServerPort(std::string ipc_id = "keymapper");
   Socket socket() const { return m_connection.socket(); }
   bool connect();
   void disconnect();
-  bool send_config(const Config& config);
+  bool send_config(const Config& config,
+    uint8_t encoding = configuration_encoding);
   bool send_active_contexts(const std::vector<int>& indices);
   bool send_validate_state();
   bool send_set_virtual_key_state(Key key, KeyState state);
   bool send_request_next_key_info();
+  bool send_request_statistics();
+  bool send_request_mapping_profile(bool start);
+  bool send_request_trace(bool start);
   bool send_inject_input(const KeySequence& sequence);
   bool send_inject_output(const KeySequence& sequence);
 
@@ -24,10 +29,23 @@ public:
     virtual void on_execute_action_message(int action_index) = 0;
     virtual void on_virtual_key_state_message(Key key, KeyState state) = 0;
     virtual void on_next_key_info_message(const std::vector<Key>& keys, DeviceDesc device) = 0;
+    virtual void on_statistics_message(const std::string& statistics) = 0;
+    virtual void on_mapping_profile_message(
+      const std::vector<Stage::ContextProfile>& context_profiles) = 0;
+    virtual void on_trace_message(const std::vector<TraceRecord>& records) = 0;
   };
   bool read_messages(MessageHandler& handler, std::optional<Duration> timeout);
 
 private:
+  bool send_serialized_config(bool allow_shared);
+
   Host m_host;
   Connection m_connection;
+  // sent when keymapperd does not know the hash yet
+  Serializer m_config;
+  uint64_t m_config_hash{ };
+  // changes are sent relative to the last sent active contexts
+  std::optional<std::vector<int>> m_sent_active_contexts;
+  std::vector<int> m_removed_contexts;
+  std::vector<int> m_added_contexts;
 };
@@ -57,6 +57,18 @@ bool FocusedWindowImpl::update() {
   return updated;
 }
 
+bool FocusedWindowImpl::get_wait_fds(std::vector<int>* fds) const {
+  auto polling = false;
+  for (const auto& system : m_systems) {
+    const auto fd = system->wait_fd();
+    if (fd >= 0)
+      fds->push_back(fd);
+    else
+      polling = true;
+  }
+  return !polling;
+}
+
 //-------------------------------------------------------------------------
 
 FocusedWindow::FocusedWindow()
@@ -94,6 +106,10 @@ bool FocusedWindow::is_inaccessible() const {
   return true;
 }
 
+bool FocusedWindow::get_wait_fds(std::vector<int>* fds) const {
+  return m_impl->get_wait_fds(fds);
+}
+
 //-------------------------------------------------------------------------
 
 std::string get_process_path_by_pid(int pid) {
@@ -32,6 +32,7 @@ private:
   Atom m_net_wm_pid_atom{ };
   Atom m_utf8_string_atom{ };
   Window m_focused_window{ };
+  Window m_observed_window{ };
 
 public:
   explicit FocusedWindowX11(FocusedWindowData* data)
@@ -57,14 +58,32 @@ public:
     m_net_wm_pid_atom = XInternAtom(m_display, "_NET_WM_PID", False);
     m_utf8_string_atom = XInternAtom(m_display, "UTF8_STRING", False);
     XSetErrorHandler([](Display*, XErrorEvent*) { return 0; });
+
+    // get notified when the active window changes
+    XSelectInput(m_display, m_root_window, PropertyChangeMask);
     return true;
   }
 
+  int wait_fd() const override {
+    return ConnectionNumber(m_display);
+  }
+
   bool update() override {
+    // query again when properties changed in the meantime
+    auto updated = false;
+    do {
+      updated |= update_focused_window();
+    } while (discard_events());
+    return updated;
+  }
+
+private:
+  bool update_focused_window() {
     if (m_on_xwayland && !g_updating_xwayland_focus)
       return false;
 
     const auto window = get_focused_window();
+    observe_window(window);
     auto window_class = get_window_class(window);
 
     // check if window class still matches (xwayland has the focus)
@@ -88,7 +107,28 @@ public:
     return true;
   }
 
-private:
+  bool discard_events() {
+    auto discarded = false;
+    auto event = XEvent{ };
+    while (XPending(m_display)) {
+      XNextEvent(m_display, &event);
+      discarded = true;
+    }
+    return discarded;
+  }
+
+  void observe_window(Window window) {
+    if (window == m_observed_window)
+      return;
+
+    // get notified when the title of the focused window changes
+    if (m_observed_window)
+      XSelectInput(m_display, m_observed_window, NoEventMask);
+    if (window)
+      XSelectInput(m_display, window, PropertyChangeMask);
+    m_observed_window = window;
+  }
+
   Window get_focused_window() {
     auto type = Atom{ };
     auto format = 0;
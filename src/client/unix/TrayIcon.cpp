@@ -39,6 +39,12 @@ void TrayIcon::update() {
     m_impl->update();
 }
 
+bool TrayIcon::get_wait_fds(std::vector<int>* fds, int* timeout_ms) {
+  if (m_impl)
+    return m_impl->get_wait_fds(fds, timeout_ms);
+  return true;
+}
+
 void TrayIcon::on_active_toggled(bool active) {
   if (m_impl)
     m_impl->on_active_toggled(active);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 class TrayIcon {
 public:
@@ -20,6 +21,10 @@ public:
     virtual bool initialize(Handler* handler, bool show_reload) = 0;
     virtual void update() = 0;
     virtual void on_active_toggled(bool active) { }
+    // returns false when events can only be processed by polling
+    virtual bool get_wait_fds(std::vector<int>* fds, int* timeout_ms) { 
+      return false; 
+    }
   };
 
   TrayIcon();
@@ -31,6 +36,7 @@ public:
   void reset();
   void update();
   void on_active_toggled(bool active);
+  bool get_wait_fds(std::vector<int>* fds, int* timeout_ms);
 
 private:
   std::unique_ptr<IImpl> m_impl;
@@ -3,6 +3,7 @@
 
 #include "TrayIcon.h"
 #include <gtk/gtk.h>
+#include <vector>
 #if __has_include(<libayatana-appindicator/app-indicator.h>)
 # undef G_GNUC_DEPRECATED
 # define G_GNUC_DEPRECATED
@@ -37,6 +38,7 @@ private:
     
   AppIndicator* m_app_indicator{ };
   GtkWidget* m_active_checkbox{ };
+  std::vector<GPollFD> m_poll_fds;
 
 public:
   ~TrayIconGtk() {
@@ -94,6 +96,35 @@ public:
       gtk_main_iteration();
   }
 
+  bool get_wait_fds(std::vector<int>* fds, int* timeout_ms) override {
+    // wait for the file descriptors of the main context
+    auto context = g_main_context_default();
+    if (!g_main_context_acquire(context))
+      return false;
+
+    auto max_priority = 0;
+    if (g_main_context_prepare(context, &max_priority))
+      *timeout_ms = 0;
+
+    auto timeout = -1;
+    auto count = 0;
+    for (;;) {
+      count = g_main_context_query(context, max_priority, &timeout,
+        m_poll_fds.data(), static_cast<gint>(m_poll_fds.size()));
+      if (count <= static_cast<int>(m_poll_fds.size()))
+        break;
+      m_poll_fds.resize(count);
+    }
+    g_main_context_release(context);
+
+    for (auto i = 0; i < count; ++i)
+      if (m_poll_fds[i].events & G_IO_IN)
+        fds->push_back(m_poll_fds[i].fd);
+    if (timeout >= 0 && (*timeout_ms < 0 || timeout < *timeout_ms))
+      *timeout_ms = timeout;
+    return true;
+  }
+
   void on_active_toggled(bool active) override {
     gtk_check_menu_item_set_active(cast(m_active_checkbox), active);
   }
@@ -10,6 +10,8 @@
 #include <fcntl.h>
 #include <sys/wait.h>
 #include <pwd.h>
+#include <poll.h>
+#include <cmath>
 
 #if defined(ENABLE_COCOA)
 extern void showMessageBoxCocoa(const char* message, const char* title);
@@ -99,9 +101,8 @@ namespace {
   }
   
   void ClientStateImpl::on_reload_config() {
-    g_state.update_config(false);
-    g_state.send_config();
-    update_options();
+    // sent by main loop once parsing completed
+    g_state.update_config_in_background(false);
   }
   
   void ClientStateImpl::on_request_next_key_info() {
@@ -125,20 +126,57 @@ namespace {
     ::wait(&child_status);
   }
 
+  // blocks until one of the file descriptors is readable or timeout
+  void wait_until_readable(const std::vector<int>& fds, 
+      std::optional<Duration> timeout, std::vector<pollfd>& poll_fds) {
+    poll_fds.clear();
+    for (auto fd : fds)
+      poll_fds.push_back({ fd, POLLIN, 0 });
+    const auto timeout_ms = (!timeout ? -1 : static_cast<int>(
+      std::ceil(std::chrono::duration<double, std::milli>(*timeout).count())));
+    ::poll(poll_fds.data(), poll_fds.size(), timeout_ms);
+  }
+
   void main_loop() {
+    auto wait_fds = std::vector<int>();
+    auto poll_fds = std::vector<pollfd>();
+
     while (!g_shutdown) {
-      if (g_auto_update_config &&
-          g_state.update_config(true)) {
+      const auto update_config = 
+        (g_auto_update_config || g_state.is_updating_config());
+      if (update_config &&
+          g_state.update_config_in_background(true)) {
         if (!g_state.send_config())
           return;
         update_options();
       }
 
+      // keymapperd only applies the latest of the contexts sent meanwhile
       if (g_state.update_active_contexts())
         if (!g_state.send_active_contexts())
           return;
 
-      if (!g_state.read_server_messages(update_interval))
+      // wait for the next event, poll sources which provide none
+      wait_fds.clear();
+      auto polling = false;
+      if (!g_state.get_wait_fds(&wait_fds))
+        polling = true;
+      if (update_config && 
+          !g_state.get_config_wait_fds(&wait_fds))
+        polling = true;
+      auto tray_timeout_ms = -1;
+      if (!g_tray_icon.get_wait_fds(&wait_fds, &tray_timeout_ms))
+        polling = true;
+
+      auto timeout = std::optional<Duration>();
+      if (polling)
+        timeout = update_interval;
+      if (tray_timeout_ms >= 0)
+        timeout = std::min(timeout.value_or(Duration::max()), 
+          Duration(std::chrono::milliseconds(tray_timeout_ms)));
+
+      wait_until_readable(wait_fds, timeout, poll_fds);
+      if (!g_state.read_server_messages(Duration::zero()))
         return;
 
       g_state.accept_control_connection();
@@ -13,9 +13,21 @@
 #include <unistd.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+
+namespace {
+  // not more are expected to be passed along with a message
+  const auto max_file_descriptors = size_t{ 4 };
+} // namespace
 
 #endif // !defined(_WIN32)
 
+namespace {
+  // consumed messages are only removed when the read buffer is empty
+  // or when they exceed this size
+  const auto max_consumed_size = size_t{ 1024 * 1024 };
+} // namespace
+
 timeval to_timeval(const Duration& duration) {
   using namespace std::chrono;
   if (duration < Duration::zero())
@@ -49,7 +61,12 @@ Connection::Connection(Socket socket)
 Connection::Connection(Connection&& rhs) noexcept
   : m_socket_fd(std::exchange(rhs.m_socket_fd, invalid_socket)),
     m_serializer(std::move(rhs.m_serializer)),
-    m_deserializer(std::move(rhs.m_deserializer)) {
+    m_deserializer(std::move(rhs.m_deserializer)),
+    m_read_offset(std::exchange(rhs.m_read_offset, 0))
+#if !defined(_WIN32)
+    , m_file_descriptors(std::move(rhs.m_file_descriptors))
+#endif
+  {
 }
 
 Connection& Connection::operator=(Connection&& rhs) noexcept {
@@ -57,6 +74,10 @@ Connection& Connection::operator=(Connection&& rhs) noexcept {
   std::swap(m_socket_fd, tmp.m_socket_fd);
   std::swap(m_serializer, tmp.m_serializer);
   std::swap(m_deserializer, tmp.m_deserializer);
+  std::swap(m_read_offset, tmp.m_read_offset);
+#if !defined(_WIN32)
+  std::swap(m_file_descriptors, tmp.m_file_descriptors);
+#endif
   return *this;
 }
 
@@ -71,6 +92,10 @@ void Connection::disconnect() {
   }
   m_serializer.buffer.clear();
   m_deserializer.buffer.clear();
+  m_read_offset = 0;
+#if !defined(_WIN32)
+  close_file_descriptors();
+#endif
 }
 
 bool Connection::wait_for_message(std::optional<Duration> timeout) {
@@ -91,11 +116,86 @@ bool Connection::send(const char* buffer, size_t length) {
   return true;
 }
 
+#if !defined(_WIN32)
+bool Connection::send(const char* buffer, size_t length, int file_descriptor) {
+  if (length == 0)
+    return false;
+
+  auto iov = iovec{ const_cast<char*>(buffer), length };
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = { };
+  auto message = msghdr{ };
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  auto cmsg = CMSG_FIRSTHDR(&message);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  std::memcpy(CMSG_DATA(cmsg), &file_descriptor, sizeof(int));
+
+  for (;;) {
+    const auto result = ::sendmsg(m_socket_fd, &message, 0);
+    if (result == -1 && (errno == EINTR || errno == EWOULDBLOCK))
+      continue;
+    if (result <= 0)
+      return false;
+    // file descriptor was passed along with the first bytes
+    return send(buffer + result, length - static_cast<size_t>(result));
+  }
+}
+
+std::optional<int> Connection::take_file_descriptor() {
+  if (m_file_descriptors.empty())
+    return std::nullopt;
+  const auto file_descriptor = m_file_descriptors.front();
+  m_file_descriptors.erase(m_file_descriptors.begin());
+  return file_descriptor;
+}
+
+void Connection::close_file_descriptors() {
+  for (auto file_descriptor : m_file_descriptors)
+    ::close(file_descriptor);
+  m_file_descriptors.clear();
+}
+#endif // !defined(_WIN32)
+
 int Connection::recv(char* buffer, size_t length) {
   auto read = 0;
   while (length != 0) {
+#if defined(_WIN32)
     const auto result = ::recv(m_socket_fd, buffer,
       static_cast<int>(length), 0);
+#else
+    // also receive file descriptors passed along
+    auto iov = iovec{ buffer, length };
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * max_file_descriptors)];
+    auto message = msghdr{ };
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+# if defined(MSG_CMSG_CLOEXEC)
+    const auto result = ::recvmsg(m_socket_fd, &message, MSG_CMSG_CLOEXEC);
+# else
+    const auto result = ::recvmsg(m_socket_fd, &message, 0);
+# endif
+    if (result > 0)
+      for (auto cmsg = CMSG_FIRSTHDR(&message); cmsg; 
+           cmsg = CMSG_NXTHDR(&message, cmsg))
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+          const auto count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+          for (auto i = 0u; i < count; ++i) {
+            auto file_descriptor = 0;
+            std::memcpy(&file_descriptor, 
+              CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+            if (m_file_descriptors.size() < max_file_descriptors)
+              m_file_descriptors.push_back(file_descriptor);
+            else
+              ::close(file_descriptor);
+          }
+        }
+#endif
 #if defined(_WIN32)
     if (result == -1 && WSAGetLastError() == WSAEWOULDBLOCK)
       break;
@@ -114,6 +214,25 @@ int Connection::recv(char* buffer, size_t length) {
   return read;
 }
 
+void Connection::reserve_buffers(size_t size) {
+  m_serializer.buffer.reserve(size);
+  m_deserializer.buffer.reserve(size);
+}
+
+void Connection::consume_read_buffer() {
+  auto& buffer = m_deserializer.buffer;
+  if (m_read_offset == buffer.size()) {
+    // keep capacity
+    buffer.clear();
+    m_read_offset = 0;
+  }
+  else if (m_read_offset > max_consumed_size) {
+    buffer.erase(buffer.begin(), buffer.begin() + 
+      static_cast<std::ptrdiff_t>(m_read_offset));
+    m_read_offset = 0;
+  }
+}
+
 bool Connection::recv(std::vector<char>& buffer) {
   const auto buffer_grow_size = 1024;
   auto pos = buffer.size();
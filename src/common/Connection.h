@@ -1,5 +1,6 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <string>
@@ -42,6 +43,23 @@ public:
     write(value.data(), sizeof(T) * value.size());
   }
 
+  // LEB128, small values take a single byte
+  void write_varint(uint64_t value) {
+    while (value >= 0x80) {
+      write(static_cast<uint8_t>(value | 0x80));
+      value >>= 7;
+    }
+    write(static_cast<uint8_t>(value));
+  }
+
+  // zigzag encoded, so small negative values also stay small
+  void write_signed_varint(int64_t value) {
+    write_varint((static_cast<uint64_t>(value) << 1) ^ 
+      static_cast<uint64_t>(value >> 63));
+  }
+
+  const std::vector<char>& data() const { return buffer; }
+
 private:
   friend class Connection;
   std::vector<char> buffer;
@@ -49,9 +67,15 @@ private:
 
 class Deserializer {
 public:
+  Deserializer() = default;
+  // reads from memory, which is owned by the caller
+  Deserializer(const char* data, size_t size)
+    : it(data), end(data + size) {
+  }
+
   void read(void* data, size_t size) {
     if (size && can_read(size)) {
-      std::memcpy(data, &*it, size);
+      std::memcpy(data, it, size);
       it += size;
     }
   }
@@ -75,6 +99,38 @@ public:
     return result;
   }
 
+  uint64_t read_varint() {
+    auto value = uint64_t{ };
+    for (auto shift = 0; shift < 64 && can_read(1); shift += 7) {
+      const auto byte = read<uint8_t>();
+      value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if (!(byte & 0x80))
+        break;
+    }
+    return value;
+  }
+
+  int64_t read_signed_varint() {
+    const auto value = read_varint();
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+  }
+
+  // each element takes at least one byte, which bounds a corrupted count
+  size_t read_count() {
+    const auto count = read_varint();
+    return static_cast<size_t>(std::min<uint64_t>(count, 
+      static_cast<uint64_t>(end - it)));
+  }
+
+  // returns a deserializer for the following size bytes, 
+  // which is empty when they cannot be read
+  Deserializer read_block(size_t size) {
+    if (!can_read(size))
+      return { };
+    it += size;
+    return Deserializer(it - size, size);
+  }
+
   template<typename T, typename = std::enable_if_t<std::is_trivially_copyable_v<T>>>
   std::vector<T> read_vector() {
     auto result = std::vector<T>{ };
@@ -84,13 +140,14 @@ public:
   }
 
   bool can_read(size_t length) const { 
-    return (it - buffer.begin() + length <= buffer.size()); 
+    return (length <= static_cast<size_t>(end - it)); 
   }
 
 private:
   friend class Connection;
   std::vector<char> buffer;
-  std::vector<char>::iterator it;
+  const char* it{ };
+  const char* end{ };
 };
 
 class Connection {
@@ -105,6 +162,7 @@ public:
   Socket socket() const { return m_socket_fd; }
   explicit operator bool() const { return m_socket_fd != invalid_socket; }
   void disconnect();
+  void reserve_buffers(size_t size);
 
   template<typename T>
   bool send(const T& value) {
@@ -118,17 +176,22 @@ public:
 
   template<typename F> // void(Serializer&)
   bool send_message(F&& write_message) {
-    // serialize messages to buffer
-    auto& buffer = m_serializer.buffer;
-    buffer.clear();
-    write_message(m_serializer);
+    const auto& buffer = serialize_message(write_message);
+    return send(buffer.data(), buffer.size());
+  }
 
-    // send message size and buffer
-    auto size = static_cast<Size>(buffer.size());
-    return send(reinterpret_cast<char*>(&size), sizeof(size)) &&
-           send(buffer.data(), buffer.size());
+#if !defined(_WIN32)
+  // passes a file descriptor along with the message
+  template<typename F> // void(Serializer&)
+  bool send_message(F&& write_message, int file_descriptor) {
+    const auto& buffer = serialize_message(write_message);
+    return send(buffer.data(), buffer.size(), file_descriptor);
   }
 
+  // returns the file descriptor passed along with the current message
+  std::optional<int> take_file_descriptor();
+#endif
+
   template<typename F> // void(Deserializer&)
   bool read_messages(std::optional<Duration> timeout, F&& deserialize) {
     // block until message can be read or timeout
@@ -141,8 +204,9 @@ public:
     if (!recv(buffer))
       return false;
 
-    // deserialize complete messages
-    m_deserializer.it = buffer.begin();
+    // deserialize complete messages, following the already consumed
+    m_deserializer.it = buffer.data() + m_read_offset;
+    m_deserializer.end = buffer.data() + buffer.size();
     while (m_deserializer.can_read(sizeof(Size))) {
       const auto size = m_deserializer.read<Size>();
       if (!m_deserializer.can_read(size)) {
@@ -154,17 +218,40 @@ public:
       if (m_deserializer.it != end)
         return false;
     }
-    buffer.erase(buffer.begin(), m_deserializer.it);
+    m_read_offset = static_cast<size_t>(m_deserializer.it - buffer.data());
+    consume_read_buffer();
     return true;
   }
 
 private:
+  template<typename F> // void(Serializer&)
+  const std::vector<char>& serialize_message(F&& write_message) {
+    // serialize message after a placeholder for its size,
+    // so both can be sent at once
+    auto& buffer = m_serializer.buffer;
+    buffer.resize(sizeof(Size));
+    write_message(m_serializer);
+    const auto size = static_cast<Size>(buffer.size() - sizeof(Size));
+    std::memcpy(buffer.data(), &size, sizeof(Size));
+    return buffer;
+  }
+
+  void consume_read_buffer();
   bool wait_for_message(std::optional<Duration> timeout);
   bool send(const char* buffer, size_t length);
   int recv(char* buffer, size_t length);
   bool recv(std::vector<char>& buffer);
+#if !defined(_WIN32)
+  bool send(const char* buffer, size_t length, int file_descriptor);
+  void close_file_descriptors();
+#endif
 
   Socket m_socket_fd{ invalid_socket };
   Serializer m_serializer;
   Deserializer m_deserializer;
+  // end of messages in read buffer which were already deserialized
+  size_t m_read_offset{ };
+#if !defined(_WIN32)
+  std::vector<int> m_file_descriptors;
+#endif
 };
@@ -6,3 +6,7 @@ using Duration = std::chrono::duration<double>;
 using Clock = std::chrono::steady_clock;
 
 struct timeval to_timeval(const Duration& duration);
+
+inline double milliseconds_since(Clock::time_point time) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - time).count();
+}
@@ -2,6 +2,11 @@
 
 #include <cstdint>
 
+// encoding of configurations, the fixed width encoding is still read
+const uint8_t configuration_encoding_fixed_width = 0;
+const uint8_t configuration_encoding_varint = 1;
+const uint8_t configuration_encoding = configuration_encoding_varint;
+
 enum class MessageType : uint8_t {
   configuration = 1,
   active_contexts,
@@ -18,4 +23,11 @@ enum class MessageType : uint8_t {
   inject_output,
   set_key_state,
   notify,
+  statistics,
+  mapping_profile,
+  trace,
+  configuration_hash,
+  request_configuration,
+  shared_configuration,
+  active_contexts_delta,
 };
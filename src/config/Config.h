@@ -9,6 +9,7 @@ struct Config {
     KeySequence input;
     // positive for direct-, negative for command output
     int output_index;
+    int line_no;
   };
 
   struct CommandOutput {
@@ -30,6 +31,7 @@ struct Config {
     bool invert_modifier_filter{ };
     bool fallthrough{ };
     bool begin_stage{ };
+    int line_no{ };
 
     bool matches(const std::string& window_class,
                  const std::string& window_title,
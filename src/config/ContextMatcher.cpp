@@ -0,0 +1,115 @@
+
+#include "ContextMatcher.h"
+#include <algorithm>
+
+namespace {
+  const auto match_cache_size = size_t{ 16 };
+
+  bool same_filter(const Filter& a, const Filter& b) {
+    return (a.string == b.string && a.invert == b.invert);
+  }
+
+  bool is_exact_class_filter(const Filter& filter) {
+    return (filter && !filter.regex && !filter.invert);
+  }
+} // namespace
+
+void ContextMatcher::set_contexts(
+    const std::vector<Config::Context>& contexts) {
+  m_filters.clear();
+  m_contexts_by_class.clear();
+  m_other_contexts.clear();
+  m_cache.clear();
+
+  for (auto i = 0; i < static_cast<int>(contexts.size()); ++i) {
+    const auto& context = contexts[i];
+    auto filters = ContextFilters{ i, { -1, -1, -1 } };
+    filters.filters[1] = add_filter(Field::window_title,
+      context.window_title_filter);
+    filters.filters[2] = add_filter(Field::window_path,
+      context.window_path_filter);
+
+    const auto& class_filter = context.window_class_filter;
+    if (is_exact_class_filter(class_filter)) {
+      m_contexts_by_class[class_filter.string].push_back(filters);
+    }
+    else {
+      filters.filters[0] = add_filter(Field::window_class, class_filter);
+      m_other_contexts.push_back(filters);
+    }
+  }
+  m_filter_results.resize(m_filters.size());
+}
+
+int ContextMatcher::add_filter(Field field, const Filter& filter) {
+  // an empty filter matches everything
+  if (!filter && !filter.invert)
+    return -1;
+
+  const auto it = std::find_if(m_filters.begin(), m_filters.end(),
+    [&](const auto& unique) {
+      return (unique.first == field && same_filter(unique.second, filter));
+    });
+  if (it != m_filters.end())
+    return static_cast<int>(std::distance(m_filters.begin(), it));
+
+  m_filters.emplace_back(field, filter);
+  return static_cast<int>(m_filters.size()) - 1;
+}
+
+bool ContextMatcher::matches(const ContextFilters& context,
+    const std::string* const (&window)[3]) {
+  for (auto index : context.filters) {
+    if (index < 0)
+      continue;
+
+    auto& result = m_filter_results[static_cast<size_t>(index)];
+    if (result < 0) {
+      const auto& [field, filter] = m_filters[static_cast<size_t>(index)];
+      const auto substring = (field != Field::window_class);
+      result = filter.matches(*window[static_cast<int>(field)], substring);
+    }
+    if (!result)
+      return false;
+  }
+  return true;
+}
+
+const std::vector<int>& ContextMatcher::match(
+    const std::string& window_class, const std::string& window_title,
+    const std::string& window_path) {
+  const auto cached = std::find_if(m_cache.begin(), m_cache.end(),
+    [&](const CachedResult& result) {
+      return (result.window_class == window_class &&
+              result.window_title == window_title &&
+              result.window_path == window_path);
+    });
+  if (cached != m_cache.end()) {
+    std::rotate(m_cache.begin(), cached, std::next(cached));
+    return m_cache.front().context_indices;
+  }
+
+  if (m_cache.size() >= match_cache_size)
+    m_cache.pop_back();
+  auto& result = *m_cache.insert(m_cache.begin(),
+    CachedResult{ window_class, window_title, window_path, { } });
+
+  // evaluate contexts indexed by class and the others in order
+  std::fill(m_filter_results.begin(), m_filter_results.end(), -1);
+  const std::string* const window[3] = {
+    &window_class, &window_title, &window_path };
+  const auto by_class = m_contexts_by_class.find(window_class);
+  const auto none = std::vector<ContextFilters>();
+  const auto& indexed = (by_class != m_contexts_by_class.end() ?
+    by_class->second : none);
+  auto it = indexed.begin();
+  auto other = m_other_contexts.begin();
+  while (it != indexed.end() || other != m_other_contexts.end()) {
+    const auto& context = (other == m_other_contexts.end() ||
+      (it != indexed.end() && it->context_index < other->context_index) ?
+        *it++ : *other++);
+    if (matches(context, window))
+      result.context_indices.push_back(context.context_index);
+  }
+  return result.context_indices;
+}
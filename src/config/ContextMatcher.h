@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Config.h"
+#include <unordered_map>
+
+// finds the contexts matching a window. contexts are indexed by exact
+// class filters, identical filters are evaluated only once and the
+// results for the most recently focused windows are cached.
+class ContextMatcher {
+public:
+  void set_contexts(const std::vector<Config::Context>& contexts);
+  const std::vector<int>& match(const std::string& window_class,
+    const std::string& window_title, const std::string& window_path);
+
+private:
+  enum class Field : int { window_class, window_title, window_path };
+
+  struct ContextFilters {
+    int context_index;
+    // indices of unique filters, -1 when there is none
+    int filters[3];
+  };
+
+  struct CachedResult {
+    std::string window_class;
+    std::string window_title;
+    std::string window_path;
+    std::vector<int> context_indices;
+  };
+
+  int add_filter(Field field, const Filter& filter);
+  bool matches(const ContextFilters& context,
+    const std::string* const (&window)[3]);
+
+  std::vector<std::pair<Field, Filter>> m_filters;
+  // evaluated during a single match, -1 when not yet evaluated
+  std::vector<signed char> m_filter_results;
+  std::unordered_map<std::string, std::vector<ContextFilters>> m_contexts_by_class;
+  std::vector<ContextFilters> m_other_contexts;
+  // most recently used first
+  std::vector<CachedResult> m_cache;
+};
@@ -505,7 +505,8 @@ void ParseConfig::parse_directive(It it, const It end) {
   }
   else if (ident == "linux-highres-wheel-events" ||
            ident == "macos-iso-keyboard" ||
-           ident == "macos-toggle-fn") {
+           ident == "macos-toggle-fn" ||
+           ident == "profile-mappings") {
     if (read_optional_bool())
       m_config.server_directives.push_back(ident);
   }
@@ -625,6 +626,7 @@ std::vector<Key> ParseConfig::parse_forward_modifiers_list(It* it, const It end)
 
 void ParseConfig::parse_context(It it, const It end) {
   auto& context = m_config.contexts.emplace_back();
+  context.line_no = m_line_no;
 
   skip_space(&it, end);
   if (skip(&it, end, "default")) {
@@ -1074,7 +1076,7 @@ void ParseConfig::add_command(KeySequence input, std::string name) {
     m_commands.push_back({ std::move(name), output_index, false });
     command = &m_commands.back();
   }
-  context.inputs.push_back({ std::move(input), command->index });
+  context.inputs.push_back({ std::move(input), command->index, m_line_no });
 }
 
 void ParseConfig::add_mapping(KeySequence input, KeySequence output) {
@@ -1082,7 +1084,8 @@ void ParseConfig::add_mapping(KeySequence input, KeySequence output) {
   auto& context = current_context();
   context.inputs.push_back({
     std::move(input),
-    static_cast<int>(context.outputs.size())
+    static_cast<int>(context.outputs.size()),
+    m_line_no
   });
   context.outputs.push_back(std::move(output));
 }
@@ -1223,7 +1226,8 @@ void ParseConfig::prepend_forward_modifier_mappings() {
             KeyEvent(key, KeyState::Down),
             KeyEvent(key, KeyState::UpAsync)
           },
-          static_cast<int>(context.outputs.size())
+          static_cast<int>(context.outputs.size()),
+          0
         });
         context.outputs.push_back({
           KeyEvent(key, KeyState::Down)
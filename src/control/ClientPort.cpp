@@ -52,6 +52,26 @@ bool ClientPort::send_request_next_key_info() {
   });
 }
 
+bool ClientPort::send_request_statistics() {
+  return m_connection.send_message([&](Serializer& s) {
+    s.write(MessageType::statistics);
+  });
+}
+
+bool ClientPort::send_request_mapping_profile(bool start) {
+  return m_connection.send_message([&](Serializer& s) {
+    s.write(MessageType::mapping_profile);
+    s.write(start);
+  });
+}
+
+bool ClientPort::send_request_trace(bool start) {
+  return m_connection.send_message([&](Serializer& s) {
+    s.write(MessageType::trace);
+    s.write(start);
+  });
+}
+
 bool ClientPort::send_inject_input(const std::string& string) {
   return m_connection.send_message([&](Serializer& s) {
     s.write(MessageType::inject_input);
@@ -118,3 +138,51 @@ bool ClientPort::read_next_key_info(std::optional<Duration> timeout,
       }
     });
 }
+
+bool ClientPort::read_statistics(std::optional<Duration> timeout, 
+    std::string* result) {
+  return m_connection.read_messages(timeout,
+    [&](Deserializer& d) {
+      switch (d.read<MessageType>()) {
+        case MessageType::statistics: {
+          if (result)
+            *result = d.read_string();
+          break;
+        }
+        default: 
+          break;
+      }
+    });
+}
+
+bool ClientPort::read_mapping_profile(std::optional<Duration> timeout, 
+    std::string* result) {
+  return m_connection.read_messages(timeout,
+    [&](Deserializer& d) {
+      switch (d.read<MessageType>()) {
+        case MessageType::mapping_profile: {
+          if (result)
+            *result = d.read_string();
+          break;
+        }
+        default: 
+          break;
+      }
+    });
+}
+
+bool ClientPort::read_trace(std::optional<Duration> timeout, 
+    std::string* result) {
+  return m_connection.read_messages(timeout,
+    [&](Deserializer& d) {
+      switch (d.read<MessageType>()) {
+        case MessageType::trace: {
+          if (result)
+            *result = d.read_string();
+          break;
+        }
+        default: 
+          break;
+      }
+    });
+}
@@ -15,6 +15,9 @@ public:
   bool send_set_instance_id(std::string_view id);
   bool send_set_config_file(const std::string& filename);
   bool send_request_next_key_info();
+  bool send_request_statistics();
+  bool send_request_mapping_profile(bool start);
+  bool send_request_trace(bool start);
   bool send_inject_input(const std::string& string);
   bool send_inject_output(const std::string& string);
   bool send_type_string(const std::string& string);
@@ -23,6 +26,12 @@ public:
     std::optional<KeyState>* result);
   bool read_next_key_info(std::optional<Duration> timeout, 
     std::string* result);
+  bool read_statistics(std::optional<Duration> timeout, 
+    std::string* result);
+  bool read_mapping_profile(std::optional<Duration> timeout, 
+    std::string* result);
+  bool read_trace(std::optional<Duration> timeout, 
+    std::string* result);
 
 private:
   Host m_host;
@@ -85,6 +85,21 @@ bool interpret_commandline(Settings& settings, int argc, char* argv[]) {
     else if (argument == T("--next-key-info")) {
       settings.requests.push_back({ RequestType::next_key_info, "", timeout });
     }    
+    else if (argument == T("--stats")) {
+      settings.requests.push_back({ RequestType::statistics, "", timeout });
+    }
+    else if (argument == T("--start-profiling")) {
+      settings.requests.push_back({ RequestType::start_profiling, "", timeout });
+    }
+    else if (argument == T("--profile-report")) {
+      settings.requests.push_back({ RequestType::profile_report, "", timeout });
+    }
+    else if (argument == T("--start-tracing")) {
+      settings.requests.push_back({ RequestType::start_tracing, "", timeout });
+    }
+    else if (argument == T("--trace-export")) {
+      settings.requests.push_back({ RequestType::trace_export, "", timeout });
+    }
     else if (argument == T("--set-config")) {
       if (++i >= argc)
         return false;
@@ -157,6 +172,11 @@ Usage: keymapperctl [--operation]
   --type-stdin          types a string of characters read from stdin.
   --notify "string"     shows a notification.
   --next-key-info       outputs information about the next key press.
+  --stats               outputs latency statistics of keymapperd.
+  --start-profiling     starts counting how often mappings are matched.
+  --profile-report      outputs how often and how long mappings were matched.
+  --start-tracing       starts recording a trace of the input processing.
+  --trace-export        outputs the recorded trace as Chrome trace JSON.
   --set-config "file"   sets a new configuration.
   --is-pressed <key>    sets the result code 0 when a virtual key is down.
   --is-released <key>   sets the result code 0 when a virtual key is up.
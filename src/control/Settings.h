@@ -21,6 +21,11 @@ enum class RequestType {
   print_result,
   set_config_file,
   next_key_info,
+  statistics,
+  start_profiling,
+  profile_report,
+  start_tracing,
+  trace_export,
   inject_input,
   inject_output,
   type_string,
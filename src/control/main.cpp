@@ -92,6 +92,57 @@ namespace {
     return Result::yes;
   }
 
+  Result request_statistics(std::optional<Duration>timeout) {
+    if (!g_client.send_request_statistics())
+      return Result::connection_failed;
+    auto statistics = std::string();
+    if (!g_client.read_statistics(timeout, &statistics))
+      return Result::connection_failed;
+    if (statistics.empty())
+      return Result::timeout;
+    std::fputs(statistics.c_str(), stdout);
+    std::fflush(stdout);
+    return Result::yes;
+  }
+
+  Result request_mapping_profile(bool start, std::optional<Duration>timeout) {
+    if (!g_client.send_request_mapping_profile(start))
+      return Result::connection_failed;
+    auto report = std::string();
+    if (!g_client.read_mapping_profile(timeout, &report))
+      return Result::connection_failed;
+    if (report.empty())
+      return Result::timeout;
+    if (!start) {
+      std::fputs(report.c_str(), stdout);
+      std::fflush(stdout);
+    }
+    return Result::yes;
+  }
+
+  Result request_trace(bool start, std::optional<Duration>timeout) {
+    if (!g_client.send_request_trace(start))
+      return Result::connection_failed;
+
+    // a trace can be received in multiple parts
+    const auto timeout_at = (timeout ? 
+      std::make_optional(Clock::now() + *timeout) : std::nullopt);
+    auto json = std::string();
+    while (json.empty()) {
+      const auto remaining = (timeout_at ?
+        std::make_optional(Duration(*timeout_at - Clock::now())) : std::nullopt);
+      if (remaining && *remaining <= Duration::zero())
+        return Result::timeout;
+      if (!g_client.read_trace(remaining, &json))
+        return Result::connection_failed;
+    }
+    if (!start) {
+      std::fputs(json.c_str(), stdout);
+      std::fflush(stdout);
+    }
+    return Result::yes;
+  }
+
   Result inject_input(const std::string& string, std::optional<Duration>timeout) {
     if (!g_client.send_inject_input(string))
       return Result::connection_failed;
@@ -198,6 +249,21 @@ namespace {
       case RequestType::next_key_info:
         return request_next_key_info(request.timeout);
 
+      case RequestType::statistics:
+        return request_statistics(request.timeout);
+
+      case RequestType::start_profiling:
+        return request_mapping_profile(true, request.timeout);
+
+      case RequestType::profile_report:
+        return request_mapping_profile(false, request.timeout);
+
+      case RequestType::start_tracing:
+        return request_trace(true, request.timeout);
+
+      case RequestType::trace_export:
+        return request_trace(false, request.timeout);
+
       case RequestType::inject_input:
         return inject_input(request.string, request.timeout);
 
@@ -0,0 +1,173 @@
+
+#include "config/ParseConfig.h"
+#include "config/get_key_name.h"
+#include "runtime/create_multi_stage.h"
+#include "server/ServerState.h"
+#include "server/ClientPortStub.h"
+#include "server/Recording.h"
+#include "common/output.h"
+#include <fstream>
+#include <string_view>
+#include <thread>
+
+namespace {
+  class ReplayState : public ServerState {
+  public:
+    ReplayState()
+      : ServerState(std::make_unique<ClientPortStub>()) {
+    }
+
+    using ServerState::on_directives_message;
+
+    const KeySequence& output() const { return m_output; }
+
+  private:
+    bool on_send_key(const KeyEvent& event) override {
+      m_output.push_back(event);
+      return true;
+    }
+
+    void on_grab_device_filters_message(std::vector<GrabDeviceFilter> filters) override { }
+    void on_exit_requested() override { }
+
+    KeySequence m_output;
+  };
+
+  struct Settings {
+    bool original_timing;
+    std::string config_filename;
+    std::string recording_filename;
+  };
+
+  bool interpret_commandline(Settings& settings, int argc, char* argv[]) {
+    for (auto i = 1; i < argc; i++) {
+      const auto argument = std::string_view(argv[i]);
+      if (argument == "--timing")
+        settings.original_timing = true;
+      else if (argument == "-v" || argument == "--verbose")
+        g_verbose_output = true;
+      else if (settings.config_filename.empty())
+        settings.config_filename = argument;
+      else if (settings.recording_filename.empty())
+        settings.recording_filename = argument;
+      else
+        return false;
+    }
+    return !settings.recording_filename.empty();
+  }
+
+  void print_help_message() {
+    message(
+      "replay-keymapper %s\n"
+      "\n"
+      "Usage: replay-keymapper [-options] \"config\" \"recording\"\n"
+      "  --timing             replay with the original timing.\n"
+      "  -v, --verbose        enable verbose output.\n"
+      "\n"
+      "Recordings are written by keymapperd --record \"file\".\n"
+      "\n", about_header);
+  }
+
+  std::optional<Config> read_config(const std::string& filename) try {
+    auto stream = std::ifstream(filename);
+    if (!stream.good()) {
+      error("Opening configuration '%s' failed", filename.c_str());
+      return std::nullopt;
+    }
+    auto parse_config = ParseConfig();
+    return parse_config(stream,
+      std::filesystem::path(filename).parent_path());
+  }
+  catch (const std::exception& ex) {
+    error("%s", ex.what());
+    return std::nullopt;
+  }
+
+  std::string format_event(const KeyEvent& event) {
+    auto string = std::string(event.state == KeyState::Down ? "+" :
+                              event.state == KeyState::Up ? "-" : "*");
+    if (auto key_name = get_key_name(event.key))
+      return string + key_name;
+    return string + std::to_string(*event.key);
+  }
+
+  void print_divergence(const KeySequence& recorded, const KeySequence& replayed) {
+    const auto [recorded_it, replayed_it] = std::mismatch(
+      recorded.begin(), recorded.end(), replayed.begin(), replayed.end());
+    if (recorded_it == recorded.end() && replayed_it == replayed.end()) {
+      message("Output of %u events matches recording", recorded.size());
+      return;
+    }
+    const auto index = std::distance(recorded.begin(), recorded_it);
+    message("Output diverges at event %u (recorded %u, replayed %u events): "
+      "expected '%s', got '%s'", index, recorded.size(), replayed.size(),
+      (recorded_it != recorded.end() ? format_event(*recorded_it).c_str() : "end"),
+      (replayed_it != replayed.end() ? format_event(*replayed_it).c_str() : "end"));
+  }
+} // namespace
+
+int main(int argc, char* argv[]) {
+  auto settings = Settings{ };
+  if (!interpret_commandline(settings, argc, argv)) {
+    print_help_message();
+    return 1;
+  }
+
+  auto config = read_config(settings.config_filename);
+  if (!config)
+    return 1;
+
+  auto events = std::vector<RecordedEvent>();
+  if (!read_recording(settings.recording_filename, &events)) {
+    error("Reading recording '%s' failed", settings.recording_filename.c_str());
+    return 1;
+  }
+
+  auto state = ReplayState();
+  state.reset_configuration(create_multi_stage(*config));
+  state.on_directives_message(config->server_directives);
+
+  auto recorded_output = KeySequence();
+  auto latency = LatencyHistogram();
+  auto input_count = 0;
+  const auto begin = Clock::now();
+  for (const auto& event : events) {
+    const auto time = begin + event.time;
+    if (settings.original_timing) {
+      if (auto flush_at = state.flush_scheduled_at(); flush_at && *flush_at < time) {
+        std::this_thread::sleep_until(*flush_at);
+        state.flush_send_buffer();
+      }
+      std::this_thread::sleep_until(time);
+    }
+    else if (state.flush_scheduled_at()) {
+      state.flush_send_buffer();
+    }
+
+    if (event.type == RecordedEvent::Type::input) {
+      const auto start = Clock::now();
+      state.replay_event(event, time);
+      if (!state.flush_scheduled_at())
+        state.flush_send_buffer();
+      latency.add(Clock::now() - start);
+      ++input_count;
+    }
+    else if (event.type == RecordedEvent::Type::output) {
+      recorded_output.push_back(event.event);
+    }
+    else {
+      state.replay_event(event, time);
+    }
+  }
+  state.flush_send_buffer();
+  const auto elapsed = Duration(Clock::now() - begin);
+
+  message("Replayed %d input events in %.3fms (%.0f events/s)",
+    input_count, elapsed.count() * 1000.0, input_count / elapsed.count());
+  message("Latency p50 %.3fms, p99 %.3fms, maximum %.3fms",
+    latency.percentile(0.5).count() * 1000.0,
+    latency.percentile(0.99).count() * 1000.0,
+    latency.max().count() * 1000.0);
+  print_divergence(recorded_output, state.output());
+  return (recorded_output == state.output() ? 0 : 2);
+}
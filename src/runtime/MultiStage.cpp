@@ -70,6 +70,12 @@ KeySequence MultiStage::set_active_client_contexts(const std::vector<int>& indic
     for (auto index : indices)
       if (index >= indices_begin && index < indices_end)
         m_indices_buffer.push_back(index - indices_begin);
+
+    // skip stages which are not affected
+    if (m_context_active_buffer.empty() &&
+        m_indices_buffer == stage->active_client_contexts())
+      continue;
+
     auto output = stage->set_active_client_contexts(m_indices_buffer);
     m_output_buffer.insert(m_output_buffer.end(), 
       output.begin(), output.end());
@@ -78,13 +84,13 @@ KeySequence MultiStage::set_active_client_contexts(const std::vector<int>& indic
   return m_output_buffer;
 }
 
-KeySequence MultiStage::update(KeyEvent event, int device_index) {  
+KeySequence MultiStage::update(KeyEvent event, int device_index, Stage::TimePoint time) {
   m_output_buffer.push_back(event);
   
   auto first_stage = true;
   for (const auto& stage : m_stages) {
     const auto update_stage = [&](const KeyEvent& event) {
-      auto output = stage->update(event, device_index);
+      auto output = stage->update(event, device_index, time);
       m_output_buffer.insert(m_output_buffer.end(), 
         output.begin(), output.end());
       stage->reuse_buffer(std::move(output));
@@ -121,6 +127,15 @@ void MultiStage::reuse_buffer(KeySequence&& buffer) {
   m_output_buffer.clear();
 }
 
+void MultiStage::reserve_buffers(size_t size) {
+  m_output_buffer.reserve(size);
+  m_input_buffer.reserve(size);
+  m_context_active_buffer.reserve(size);
+  m_indices_buffer.reserve(size);
+  for (auto& stage : m_stages)
+    stage->reserve_buffers(size);
+}
+
 void MultiStage::validate_state(const std::function<bool(Key)>& is_down) {
   if (!m_stages.empty())
     m_stages.front()->validate_state(is_down);
@@ -19,8 +19,10 @@ public:
   std::vector<Key> get_output_keys_down() const;
   void evaluate_device_filters(const std::vector<DeviceDesc>& device_descs);
   KeySequence set_active_client_contexts(const std::vector<int>& indices);
-  KeySequence update(KeyEvent event, int device_index);
+  KeySequence update(KeyEvent event, int device_index,
+    Stage::TimePoint time = std::chrono::steady_clock::now());
   void reuse_buffer(KeySequence&& buffer);
+  void reserve_buffers(size_t size);
   void validate_state(const std::function<bool(Key)>& is_down);
   bool should_exit() const;
 
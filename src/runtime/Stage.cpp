@@ -213,10 +213,10 @@ KeySequence Stage::set_active_client_contexts(const std::vector<int> &indices) {
     assert(i >= 0 && i < static_cast<int>(m_contexts.size()));
 
   m_active_client_contexts = indices;
-  update_active_contexts();
 
-  // cancel output on release when the focus changed
-  cancel_inactive_output_on_release();
+  // cancel output on release when a context was deactivated
+  if (update_active_contexts())
+    cancel_inactive_output_on_release();
 
   // updating contexts can toggle ContextActive keys
   return std::move(m_output_buffer);
@@ -232,7 +232,7 @@ bool Stage::match_context_modifier_filter(const KeySequence& modifiers) {
   return true;
 }
 
-void Stage::update_active_contexts() {
+bool Stage::update_active_contexts() {
   std::swap(m_prev_active_contexts, m_active_contexts);
 
   // evaluate modifier and device filter of contexts which were set active by client
@@ -254,6 +254,7 @@ void Stage::update_active_contexts() {
 
   // compare current and previous active contexts indices
   // first toggle deactivated contexts' keys then activated
+  auto deactivated = false;
   for (auto toggle_activated : { false, true }) {
     auto prev_it = m_prev_active_contexts.begin();
     auto curr_it = m_active_contexts.begin();
@@ -265,8 +266,10 @@ void Stage::update_active_contexts() {
       const auto c = (curr_it != curr_end ? *curr_it : max);
       if (p < c) {
         // context #p deactivated
-        if (!toggle_activated)
+        if (!toggle_activated) {
           on_context_active_event({ Key::ContextActive, KeyState::Up }, p);
+          deactivated = true;
+        }
         ++prev_it;
       }
       else if (c < p) {
@@ -281,6 +284,7 @@ void Stage::update_active_contexts() {
       }
     }
   }
+  return deactivated;
 }
 
 void Stage::on_context_active_event(const KeyEvent& event, int context_index) {
@@ -347,17 +351,68 @@ bool Stage::should_exit() const {
   return (m_exit_sequence_position == exit_sequence.size());
 }
 
-KeySequence Stage::update(const KeyEvent event, int device_index) {
+KeySequence Stage::update(const KeyEvent event, int device_index, TimePoint time) {
+  if (m_trace)
+    return update_traced(event, device_index, time);
+
   advance_exit_sequence(event);
-  apply_input(event, device_index);
+  apply_input(event, device_index, time);
   return std::move(m_output_buffer);
 }
 
+KeySequence Stage::update_traced(const KeyEvent event, int device_index, TimePoint time) {
+  const auto begin = std::chrono::steady_clock::now();
+  m_last_match = { -1, -1 };
+  advance_exit_sequence(event);
+  apply_input(event, device_index, time);
+  m_trace->add({ begin, std::chrono::steady_clock::now() - begin, event,
+    TraceRecord::Type::stage_update, 
+    static_cast<int8_t>(m_trace_stage_index),
+    static_cast<int16_t>(device_index),
+    static_cast<int16_t>(m_last_match.first),
+    static_cast<int16_t>(m_last_match.second),
+    static_cast<uint16_t>(m_output_buffer.size()) });
+  return std::move(m_output_buffer);
+}
+
+void Stage::set_trace(TraceBuffer* trace, int stage_index) {
+  m_trace = trace;
+  m_trace_stage_index = stage_index;
+}
+
 void Stage::reuse_buffer(KeySequence&& buffer) {
   m_output_buffer = std::move(buffer);
   m_output_buffer.clear();
 }
 
+void Stage::set_profiling(bool enabled) {
+  m_profiling = enabled;
+  m_profile.clear();
+  if (enabled)
+    for (const auto& context : m_contexts)
+      m_profile.emplace_back(context.inputs.size(), MatchProfile{ });
+}
+
+void Stage::update_profile(int context_index, size_t input_index,
+    MatchResult result, TimePoint start) {
+  auto& profile = m_profile[context_index][input_index];
+  ++profile.calls;
+  if (result == MatchResult::might_match)
+    ++profile.might_matches;
+  if (result == MatchResult::match)
+    ++profile.matches;
+  profile.time += std::chrono::steady_clock::now() - start;
+}
+
+void Stage::reserve_buffers(size_t size) {
+  m_sequence.reserve(size);
+  m_history.reserve(size);
+  m_output_on_release.reserve(size);
+  m_output_down.reserve(size);
+  m_output_buffer.reserve(size);
+  m_any_key_matches.reserve(size);
+}
+
 void Stage::validate_state(const std::function<bool(Key)>& is_down) {
   m_sequence_might_match = false;
 
@@ -373,8 +428,9 @@ void Stage::validate_state(const std::function<bool(Key)>& is_down) {
   for (const auto& output : m_output_down)
     if (is_device_key(output.key) && !is_down(get_trigger_key(output.trigger)))
       release_events.emplace_back(output.key, KeyState::Up);
+  const auto now = std::chrono::steady_clock::now();
   for (const auto& event : release_events)
-    apply_input(event, any_device_index);
+    apply_input(event, any_device_index, now);
 }
 
 const KeySequence* Stage::find_output(const Context& context, int output_index) const {
@@ -429,16 +485,25 @@ auto Stage::match_input(bool first_iteration, bool matched_are_optional,
         (first_iteration && !no_might_match_mapping);
 
       auto input_timeout_event = KeyEvent{ };
+      const auto start = (m_profiling ?
+        std::chrono::steady_clock::now() : TimePoint{ });
       const auto result = m_match(input,
         (no_might_match_mapping ? m_history : sequence),
         matched_are_optional, &m_any_key_matches, &input_timeout_event);
+      const auto input_index = static_cast<int>(&context_input - context.inputs.data());
+      if (m_profiling)
+        update_profile(context_index, input_index, result, start);
 
-      if (accept_might_match && result == MatchResult::might_match)
+      if (accept_might_match && result == MatchResult::might_match) {
+        m_last_match = { context_index, input_index };
         return { MatchResult::might_match, nullptr, &input, context_index, input_timeout_event };
+      }
 
       if (result == MatchResult::match)
-        if (auto output = find_output(context, context_input.output_index))
+        if (auto output = find_output(context, context_input.output_index)) {
+          m_last_match = { context_index, input_index };
           return { MatchResult::match, output, &input, context_index, {} };
+        }
     }
   }
   return { MatchResult::no_match, nullptr, nullptr, 0, {} };
@@ -449,7 +514,7 @@ bool Stage::is_physically_pressed(Key key) const {
   return (it != cend(m_sequence) && it->state != KeyState::Up);
 }
 
-void Stage::apply_input(const KeyEvent event, int device_index) {
+void Stage::apply_input(const KeyEvent event, int device_index, TimePoint time) {
   assert(event.state == KeyState::Down ||
          event.state == KeyState::Up);
   assert(is_device_key(event.key) ||
@@ -517,7 +582,7 @@ void Stage::apply_input(const KeyEvent event, int device_index) {
   if (m_has_no_might_match_mapping && 
       !is_virtual_key(event.key) &&
       event.key != Key::timeout)    
-    add_history_event(event);
+    add_history_event(event, time);
 
   // update contexts with modifier filter
   update_active_contexts();
@@ -986,7 +1051,7 @@ void Stage::set_history_timing(std::chrono::milliseconds timeout) {
   m_history_timing_state = timeout;
 }
 
-void Stage::add_history_event(const KeyEvent& event) {
+void Stage::add_history_event(const KeyEvent& event, TimePoint time) {
   const auto is_duplicate = [&]() {
     const auto it = rfind_key(m_history, event.key);
     if (event.state == KeyState::Down)
@@ -997,7 +1062,7 @@ void Stage::add_history_event(const KeyEvent& event) {
     return;
 
   // automatically insert the time elapsed between events
-  const auto timeout_event = update_history_timing();
+  const auto timeout_event = update_history_timing(time);
   if (!m_history.empty()) {
     if (m_history.back().state == KeyState::HistoryTiming)
       m_history.back().value = sum_timeouts(timeout_event.value, m_history.back().value);
@@ -1008,17 +1073,15 @@ void Stage::add_history_event(const KeyEvent& event) {
   m_history.push_back(event);
 }
 
-KeyEvent Stage::update_history_timing() {
+KeyEvent Stage::update_history_timing(TimePoint time) {
   // use timing injected by tests
   if (const auto* timeout = std::get_if<std::chrono::milliseconds>(&m_history_timing_state))
     return make_history_timeout_event(*timeout);
 
-  // generate timing using wall clock
-  using Clock = std::chrono::steady_clock;
-  auto& last_event_time = std::get<Clock::time_point>(m_history_timing_state);
-  const auto now = Clock::now();
-  const auto time_elapsed = (now - last_event_time);
-  last_event_time = now;
+  // generate timing using the time the events occurred
+  auto& last_event_time = std::get<TimePoint>(m_history_timing_state);
+  const auto time_elapsed = (time - last_event_time);
+  last_event_time = std::max(last_event_time, time);
   return make_history_timeout_event(time_elapsed);
 }
 
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "MatchKeySequence.h"
+#include "Trace.h"
 #include "common/DeviceDesc.h"
 #include "common/Filter.h"
 #include <chrono>
@@ -17,6 +18,7 @@ public:
   static const int no_device_index = -1;
   static const int any_device_index = -2;
   static const uint64_t all_device_bits = ~uint64_t{ };
+  using TimePoint = std::chrono::steady_clock::time_point;
 
   struct Input {
     KeySequence input;
@@ -41,8 +43,22 @@ public:
     bool fallthrough{ };
   };
 
+  // how often and how long an input was matched
+  struct MatchProfile {
+    uint64_t calls;
+    uint64_t might_matches;
+    uint64_t matches;
+    std::chrono::nanoseconds time;
+  };
+  using ContextProfile = std::vector<MatchProfile>;
+
   explicit Stage(std::vector<Context> contexts = { });
   void set_virtual_keys_toggle(bool set) { m_virtual_keys_toggle = set; }
+  void set_profiling(bool enabled);
+  bool profiling() const { return m_profiling; }
+  // indexed by context and input index, empty when not profiling
+  const std::vector<ContextProfile>& profile() const { return m_profile; }
+  void set_trace(TraceBuffer* trace, int stage_index);
 
   const std::vector<Context>& contexts() const { return m_contexts; }
   const std::vector<int>& active_client_contexts() const { return m_active_client_contexts; }
@@ -56,14 +72,17 @@ public:
   void evaluate_device_filters(const std::vector<DeviceDesc>& device_descs);
   KeySequence set_active_client_contexts(const std::vector<int>& indices);
   void set_history_timing(std::chrono::milliseconds timeout);
-  KeySequence update(KeyEvent event, int device_index);
+  KeySequence update(KeyEvent event, int device_index,
+    TimePoint time = std::chrono::steady_clock::now());
   void reuse_buffer(KeySequence&& buffer);
+  void reserve_buffers(size_t size);
   void validate_state(const std::function<bool(Key)>& is_down);
   bool should_exit() const;
 
 private:
   using MatchInputResult = std::tuple<MatchResult, const KeySequence*, Trigger, int, KeyEvent>;
 
+  KeySequence update_traced(KeyEvent event, int device_index, TimePoint time);
   void advance_exit_sequence(const KeyEvent& event);
   const KeySequence* find_output(const Context& context, int output_index) const;
   bool device_matches_filter(const Context& context, int device_index) const;
@@ -71,7 +90,7 @@ private:
     ConstKeySequenceRange sequence, int device_index, 
     bool is_key_up_event);
   bool is_physically_pressed(Key key) const;
-  void apply_input(KeyEvent event, int device_index);
+  void apply_input(KeyEvent event, int device_index, TimePoint time);
   void release_triggered(Key key, int context_index = -1);
   void forward_from_sequence();
   void apply_output(ConstKeySequenceRange sequence,
@@ -80,15 +99,17 @@ private:
     const Trigger& trigger, int context_index);
   void update_output(const KeyEvent& event, const Trigger& trigger, int context_index = -1);
   void finish_sequence(ConstKeySequenceRange sequence);
+  void update_profile(int context_index, size_t input_index,
+    MatchResult result, TimePoint start);
   bool match_context_modifier_filter(const KeySequence& modifiers);
-  void update_active_contexts();
+  bool update_active_contexts();
   bool continue_output_on_release(const KeyEvent& event, int context_index = -1);
   void cancel_inactive_output_on_release();
   int fallthrough_context(int context_index) const;
   bool is_context_active(int context_index) const;
   void on_context_active_event(const KeyEvent& event, int context_index);
-  void add_history_event(const KeyEvent& event);
-  KeyEvent update_history_timing();
+  void add_history_event(const KeyEvent& event, TimePoint time);
+  KeyEvent update_history_timing(TimePoint time);
   void clean_up_history();
 
   std::vector<Context> m_contexts;
@@ -101,6 +122,12 @@ private:
   std::vector<int> m_prev_active_contexts;
   MatchKeySequence m_match;
   size_t m_exit_sequence_position{ };
+  bool m_profiling{ };
+  std::vector<ContextProfile> m_profile;
+  TraceBuffer* m_trace{ };
+  int m_trace_stage_index{ };
+  // context and input index of the last match
+  std::pair<int, int> m_last_match{ -1, -1 };
 
   // the input since the last match (or already matched but still hold)
   KeySequence m_sequence;
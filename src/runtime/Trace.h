@@ -0,0 +1,54 @@
+#pragma once
+
+#include "KeyEvent.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+// fixed-size record of a step in the processing of an input event
+struct TraceRecord {
+  enum class Type : uint8_t { translate_input, stage_update, flush };
+
+  std::chrono::steady_clock::time_point begin;
+  std::chrono::nanoseconds duration;
+  KeyEvent event;
+  Type type;
+  int8_t stage_index;
+  int16_t device_index;
+  int16_t context_index;
+  int16_t input_index;
+  uint16_t output_count;
+};
+
+// keeps the most recent records, so tracing can stay enabled
+class TraceBuffer {
+public:
+  explicit TraceBuffer(size_t capacity)
+    : m_records(capacity) {
+  }
+
+  void add(const TraceRecord& record) {
+    m_records[m_next % m_records.size()] = record;
+    ++m_next;
+  }
+
+  void clear() {
+    m_next = 0;
+  }
+
+  // returns the records in the order they were added
+  std::vector<TraceRecord> records() const {
+    const auto capacity = m_records.size();
+    const auto count = std::min(m_next, capacity);
+    auto records = std::vector<TraceRecord>();
+    records.reserve(count);
+    for (auto i = m_next - count; i < m_next; ++i)
+      records.push_back(m_records[i % capacity]);
+    return records;
+  }
+
+private:
+  std::vector<TraceRecord> m_records;
+  size_t m_next{ };
+};
@@ -0,0 +1,8 @@
+#pragma once
+
+#include "MultiStage.h"
+#include "config/Config.h"
+
+// creates the stages like keymapperd from a received configuration,
+// the contexts are moved out of the configuration
+MultiStagePtr create_multi_stage(Config& config);
@@ -1,14 +1,50 @@
 
 #include "ClientPort.h"
 #include "common/parse_regex.h"
+#include "common/output.h"
+#include <algorithm>
+#include <utility>
+
+#if defined(__linux__)
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
 
 namespace {
-  KeySequence read_key_sequence(Deserializer& d) {
+  size_t read_count(Deserializer& d, uint8_t encoding) {
+    if (encoding == configuration_encoding_fixed_width) {
+      // each element takes at least one byte, which bounds a corrupted count
+      const auto count = d.read<uint32_t>();
+      return (d.can_read(count) ? count : 0);
+    }
+    return d.read_count();
+  }
+
+  int read_index(Deserializer& d, uint8_t encoding) {
+    if (encoding == configuration_encoding_fixed_width)
+      return d.read<int32_t>();
+    return static_cast<int>(d.read_signed_varint());
+  }
+
+  KeySequence read_key_sequence(Deserializer& d, uint8_t encoding) {
     auto sequence = KeySequence();
-    auto size = d.read<uint32_t>();
+    const auto size = read_count(d, encoding);
+    if (encoding == configuration_encoding_fixed_width) {
+      for (auto i = 0u; i < size; ++i) {
+        auto& event = sequence.emplace_back();
+        d.read(&event);
+      }
+      return sequence;
+    }
+    auto key = int64_t{ };
     for (auto i = 0u; i < size; ++i) {
-      auto& event = sequence.emplace_back();
-      d.read(&event);
+      key += d.read_signed_varint();
+      const auto value = d.read_varint();
+      sequence.emplace_back(static_cast<Key>(key), 
+        static_cast<KeyState>(value & 0x0F),
+        static_cast<KeyEvent::value_t>(value >> 4));
     }
     return sequence;
   }
@@ -22,42 +58,43 @@ namespace {
     return filter;
   }
 
-  MultiStagePtr read_stages(Deserializer& d) {
-    auto stages = std::vector<StagePtr>();
-    auto contexts = std::vector<Stage::Context>();
-    const auto context_count = d.read<uint32_t>();
+  const auto configuration_cache_size = size_t{ 8 };
+
+  std::vector<std::vector<Stage::Context>> read_stage_contexts(
+      Deserializer& d, uint8_t encoding) {
+    auto stage_contexts = std::vector<std::vector<Stage::Context>>();
+    const auto context_count = read_count(d, encoding);
     for (auto i = 0u; i < context_count; ++i) {
       // begin stage
       auto begin_stage = false;
       d.read(&begin_stage);
-      if (begin_stage && !contexts.empty()) {
-        stages.emplace_back(std::make_unique<Stage>(std::move(contexts)));
-        contexts = { };
-      }
+      if (stage_contexts.empty() ||
+          (begin_stage && !stage_contexts.back().empty()))
+        stage_contexts.emplace_back();
 
-      auto& context = contexts.emplace_back();
+      auto& context = stage_contexts.back().emplace_back();
 
       // inputs
-      auto count = d.read<uint32_t>();
+      auto count = read_count(d, encoding);
       context.inputs.resize(count);
       for (auto& input : context.inputs) {
-        input.input = read_key_sequence(d);
-        input.output_index = d.read<int32_t>();
+        input.input = read_key_sequence(d, encoding);
+        input.output_index = read_index(d, encoding);
       }
 
       // outputs
-      count = d.read<uint32_t>();
+      count = read_count(d, encoding);
       context.outputs.resize(count);
       for (auto& output : context.outputs) {
-        output = read_key_sequence(d);
+        output = read_key_sequence(d, encoding);
       }
 
       // command outputs
-      count = d.read<uint32_t>();
+      count = read_count(d, encoding);
       context.command_outputs.resize(count);
       for (auto& command : context.command_outputs) {
-        command.output = read_key_sequence(d);
-        command.index = d.read<int32_t>();
+        command.output = read_key_sequence(d, encoding);
+        command.index = read_index(d, encoding);
       }
 
       // device filter
@@ -67,22 +104,27 @@ namespace {
       context.device_id_filter = read_filter(d);
 
       // modifier filter
-      context.modifier_filter = read_key_sequence(d);
+      context.modifier_filter = read_key_sequence(d, encoding);
       d.read(&context.invert_modifier_filter);
 
       // fallthrough
       d.read(&context.fallthrough);
     }
+    return stage_contexts;
+  }
 
-    if (!contexts.empty())
+  MultiStagePtr create_stages(
+      std::vector<std::vector<Stage::Context>> stage_contexts) {
+    auto stages = std::vector<StagePtr>();
+    for (auto& contexts : stage_contexts)
       stages.emplace_back(std::make_unique<Stage>(std::move(contexts)));
-
     return std::make_unique<MultiStage>(std::move(stages));
   }
 
-  std::vector<GrabDeviceFilter> read_grab_device_filters(Deserializer& d) {
+  std::vector<GrabDeviceFilter> read_grab_device_filters(
+      Deserializer& d, uint8_t encoding) {
     auto device_filters = std::vector<GrabDeviceFilter>();
-    const auto count = d.read<uint32_t>();
+    const auto count = read_count(d, encoding);
     for (auto i = 0u; i < count; ++i) {
       auto filter = read_filter(d);
       auto by_id = d.read<bool>();
@@ -91,9 +133,10 @@ namespace {
     return device_filters;
   }
 
-  std::vector<std::string> read_directives(Deserializer& d) {
+  std::vector<std::string> read_directives(Deserializer& d, 
+      uint8_t encoding) {
     auto directives = std::vector<std::string>();
-    const auto count = d.read<uint32_t>();
+    const auto count = read_count(d, encoding);
     for (auto i = 0u; i < count; ++i)
       directives.push_back(d.read_string());
     return directives;
@@ -101,14 +144,26 @@ namespace {
 
   void read_active_contexts(Deserializer& d, std::vector<int>* indices) {
     indices->clear();
-    const auto count = d.read<uint32_t>();
+    const auto count = d.read_count();
     for (auto i = 0u; i < count; ++i)
-      indices->push_back(static_cast<int>(d.read<uint32_t>()));
+      indices->push_back(static_cast<int>(d.read_varint()));
+  }
+
+  void apply_active_contexts_delta(std::vector<int>& indices,
+      const std::vector<int>& removed, const std::vector<int>& added) {
+    indices.erase(std::remove_if(indices.begin(), indices.end(),
+      [&](int index) { 
+        return std::binary_search(removed.begin(), removed.end(), index); 
+      }), indices.end());
+    const auto middle = indices.size();
+    indices.insert(indices.end(), added.begin(), added.end());
+    std::inplace_merge(indices.begin(), indices.begin() + middle, indices.end());
+    indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
   }
 } // namespace
 
-ClientPort::ClientPort() 
-  : m_host("keymapper") {
+ClientPort::ClientPort(std::string ipc_id) 
+  : m_host(std::move(ipc_id)) {
 }
 
 bool ClientPort::listen() {
@@ -117,6 +172,9 @@ bool ClientPort::listen() {
 
 bool ClientPort::accept() {
   m_connection = m_host.accept();
+  m_requested_configuration.reset();
+  m_active_contexts_pending = false;
+  m_connection.reserve_buffers(m_buffer_reserve);
   return static_cast<bool>(m_connection);
 }
 
@@ -124,11 +182,133 @@ void ClientPort::disconnect() {
   m_connection.disconnect();
 }
 
+void ClientPort::set_buffer_reserve(size_t size) {
+  m_buffer_reserve = size;
+  m_connection.reserve_buffers(size);
+}
+
 const std::vector<int>& ClientPort::read_active_contexts(Deserializer& d) {
   ::read_active_contexts(d, &m_active_context_indices);
   return m_active_context_indices;
 }
 
+const std::vector<int>& ClientPort::read_active_contexts_delta(Deserializer& d) {
+  ::read_active_contexts(d, &m_removed_context_indices);
+  ::read_active_contexts(d, &m_added_context_indices);
+  apply_active_contexts_delta(m_active_context_indices,
+    m_removed_context_indices, m_added_context_indices);
+  return m_active_context_indices;
+}
+
+void ClientPort::on_active_contexts_changed(MessageHandler& handler) {
+  if (m_requested_configuration)
+    m_active_contexts_pending = true;
+  else
+    handler.on_active_contexts_message(m_active_context_indices);
+}
+
+bool ClientPort::read_configuration_hash(MessageHandler& handler, 
+    const ConfigurationId& id) {
+  const auto it = std::find_if(m_configuration_cache.begin(), 
+    m_configuration_cache.end(), 
+    [&](const CachedConfiguration& cached) { return cached.id == id; });
+  if (it == m_configuration_cache.end()) {
+    // active contexts are delayed until configuration was received
+    verbose("Requesting configuration");
+    m_requested_configuration = id;
+    return request_configuration(id, true);
+  }
+
+  verbose("Using cached configuration");
+  std::rotate(m_configuration_cache.begin(), it, std::next(it));
+  m_requested_configuration.reset();
+  apply_configuration(handler, m_configuration_cache.front());
+  return true;
+}
+
+bool ClientPort::request_configuration(const ConfigurationId& id, 
+    bool allow_shared) {
+  return m_connection.send_message(
+    [&](Serializer& s) {
+      s.write(MessageType::request_configuration);
+      s.write(id.hash);
+      s.write(id.size);
+      s.write(allow_shared);
+    });
+}
+
+#if defined(__linux__)
+bool ClientPort::read_shared_configuration(MessageHandler& handler, 
+    const ConfigurationId& id) {
+  const auto fd = m_connection.take_file_descriptor();
+  if (!fd)
+    return false;
+
+  // only accept sealed memory, which cannot change while it is read
+  const auto required_seals = F_SEAL_SHRINK | F_SEAL_WRITE;
+  const auto seals = ::fcntl(*fd, F_GET_SEALS);
+  struct stat status{ };
+  auto succeeded = false;
+  if (seals >= 0 && (seals & required_seals) == required_seals &&
+      ::fstat(*fd, &status) == 0 && id.size > 0 &&
+      static_cast<uint64_t>(status.st_size) >= id.size) {
+    const auto data = ::mmap(nullptr, id.size, PROT_READ, MAP_PRIVATE, *fd, 0);
+    if (data != MAP_FAILED) {
+      auto d = Deserializer(static_cast<const char*>(data), id.size);
+      succeeded = read_configuration(handler, id, d);
+      ::munmap(data, id.size);
+    }
+  }
+  ::close(*fd);
+  return succeeded;
+}
+#endif
+
+bool ClientPort::read_configuration(MessageHandler& handler, 
+    const ConfigurationId& id, Deserializer& d) {
+  const auto encoding = d.read<uint8_t>();
+  if (encoding != configuration_encoding_fixed_width &&
+      encoding != configuration_encoding_varint) {
+    error("Unsupported configuration encoding");
+    return false;
+  }
+
+  auto configuration = CachedConfiguration{ };
+  configuration.id = id;
+  configuration.grab_device_filters = read_grab_device_filters(d, encoding);
+  configuration.stage_contexts = read_stage_contexts(d, encoding);
+  configuration.directives = read_directives(d, encoding);
+
+  // ignore configurations which were replaced
+  if (m_requested_configuration != configuration.id)
+    return true;
+  m_requested_configuration.reset();
+
+  if (m_configuration_cache.size() >= configuration_cache_size)
+    m_configuration_cache.pop_back();
+  m_configuration_cache.insert(m_configuration_cache.begin(),
+    std::move(configuration));
+  apply_configuration(handler, m_configuration_cache.front());
+  return true;
+}
+
+void ClientPort::cancel_configuration_request(MessageHandler& handler) {
+  // keep the current configuration and stop delaying active contexts
+  m_requested_configuration.reset();
+  if (std::exchange(m_active_contexts_pending, false))
+    handler.on_active_contexts_message(m_active_context_indices);
+}
+
+void ClientPort::apply_configuration(MessageHandler& handler,
+    const CachedConfiguration& configuration) {
+  handler.on_grab_device_filters_message(configuration.grab_device_filters);
+  handler.on_configuration_message(create_stages(configuration.stage_contexts));
+  handler.on_directives_message(configuration.directives);
+
+  if (std::exchange(m_active_contexts_pending, false))
+    handler.on_active_contexts_message(m_active_context_indices);
+}
+
 bool ClientPort::send_triggered_action(int action) {
   return m_connection.send_message(
     [&](Serializer& s) {
@@ -156,19 +336,86 @@ bool ClientPort::send_next_key_info(const std::vector<Key>& keys, const DeviceDe
     });
 }
 
+bool ClientPort::send_statistics(const std::string& statistics) {
+  return m_connection.send_message(
+    [&](Serializer& s) {
+      s.write(MessageType::statistics);
+      s.write(statistics);
+    });
+}
+
+bool ClientPort::send_mapping_profile(
+    const std::vector<Stage::ContextProfile>& context_profiles) {
+  return m_connection.send_message(
+    [&](Serializer& s) {
+      s.write(MessageType::mapping_profile);
+      s.write(static_cast<uint32_t>(context_profiles.size()));
+      for (const auto& context_profile : context_profiles)
+        s.write(context_profile);
+    });
+}
+
+bool ClientPort::send_trace(const std::vector<TraceRecord>& records) {
+  return m_connection.send_message(
+    [&](Serializer& s) {
+      s.write(MessageType::trace);
+      s.write(records);
+    });
+}
+
 bool ClientPort::read_messages(MessageHandler& handler,
     std::optional<Duration> timeout) {
-  return m_connection.read_messages(timeout,
+  // only the latest of consecutively received active contexts is applied
+  auto active_contexts_changed = false;
+  const auto apply_active_contexts = [&]() {
+    if (std::exchange(active_contexts_changed, false))
+      on_active_contexts_changed(handler);
+  };
+
+  auto succeeded = true;
+  succeeded &= m_connection.read_messages(timeout,
     [&](Deserializer& d) {
-      switch (d.read<MessageType>()) {
+      const auto type = d.read<MessageType>();
+      if (type != MessageType::active_contexts &&
+          type != MessageType::active_contexts_delta)
+        apply_active_contexts();
+
+      switch (type) {
+        case MessageType::configuration_hash: {
+          const auto id = d.read<ConfigurationId>();
+          succeeded &= read_configuration_hash(handler, id);
+          break;
+        }
         case MessageType::configuration: {
-          handler.on_grab_device_filters_message(read_grab_device_filters(d));        
-          handler.on_configuration_message(read_stages(d));
-          handler.on_directives_message(read_directives(d));
+          // the size is checked by reading exactly the serialized configuration
+          const auto id = d.read<ConfigurationId>();
+          auto configuration = d.read_block(id.size);
+          if ((!configuration.can_read(id.size) ||
+               !read_configuration(handler, id, configuration)) &&
+              m_requested_configuration == id)
+            cancel_configuration_request(handler);
           break;
         }
+#if defined(__linux__)
+        case MessageType::shared_configuration: {
+          const auto id = d.read<ConfigurationId>();
+          if (!read_shared_configuration(handler, id)) {
+            error("Reading shared configuration failed");
+            // request it again, to be passed through the socket
+            if (m_requested_configuration == id)
+              succeeded &= request_configuration(id, false);
+          }
+          break;
+        }
+#endif
         case MessageType::active_contexts: {
-          handler.on_active_contexts_message(read_active_contexts(d));
+          read_active_contexts(d);
+          active_contexts_changed = true;
+          break;
+        }
+        case MessageType::active_contexts_delta: {
+          read_active_contexts_delta(d);
+          active_contexts_changed = true;
           break;
         }
         case MessageType::set_virtual_key_state: {
@@ -185,15 +432,29 @@ bool ClientPort::read_messages(MessageHandler& handler,
           handler.on_request_next_key_info_message();
           break;
         }
+        case MessageType::statistics: {
+          handler.on_request_statistics_message();
+          break;
+        }
+        case MessageType::mapping_profile: {
+          handler.on_request_mapping_profile_message(d.read<bool>());
+          break;
+        }
+        case MessageType::trace: {
+          handler.on_request_trace_message(d.read<bool>());
+          break;
+        }
         case MessageType::inject_input: {
-          handler.on_inject_input_message(read_key_sequence(d));
+          handler.on_inject_input_message(read_key_sequence(d, configuration_encoding));
           break;
         }
         case MessageType::inject_output: {
-          handler.on_inject_output_message(read_key_sequence(d));
+          handler.on_inject_output_message(read_key_sequence(d, configuration_encoding));
           break;
         }
         default: break;
       }
     });
+  apply_active_contexts();
+  return succeeded;
 }
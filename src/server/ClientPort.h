@@ -16,6 +16,9 @@ public:
     virtual void on_set_virtual_key_state_message(Key key, KeyState state) = 0;
     virtual void on_validate_state_message() = 0;
     virtual void on_request_next_key_info_message() = 0;
+    virtual void on_request_statistics_message() = 0;
+    virtual void on_request_mapping_profile_message(bool start) = 0;
+    virtual void on_request_trace_message(bool start) = 0;
     virtual void on_inject_input_message(const KeySequence& sequence) = 0;
     virtual void on_inject_output_message(const KeySequence& sequence) = 0;
   };
@@ -27,32 +30,84 @@ public:
   virtual bool listen() = 0;
   virtual bool accept() = 0;
   virtual void disconnect() = 0;
+  virtual void set_buffer_reserve(size_t size) = 0;
   virtual bool send_triggered_action(int action) = 0;
   virtual bool send_virtual_key_state(Key key, KeyState state) = 0;
   virtual bool send_next_key_info(const std::vector<Key>& keys, const DeviceDesc& device_desc) = 0;
+  virtual bool send_statistics(const std::string& statistics) = 0;
+  virtual bool send_mapping_profile(
+    const std::vector<Stage::ContextProfile>& context_profiles) = 0;
+  virtual bool send_trace(const std::vector<TraceRecord>& records) = 0;
   virtual bool read_messages(MessageHandler& handler, 
     std::optional<Duration> timeout) = 0;
 };
 
 class ClientPort : public IClientPort {
 public:
-  ClientPort();
+  explicit ClientPort(std::string ipc_id = "keymapper");
   Socket socket() const override { return m_connection.socket(); }
   Socket listen_socket() const override { return m_host.listen_socket(); }
   bool version_mismatch() const override { return m_host.version_mismatch(); }
   bool listen() override;
   bool accept() override;
   void disconnect() override;
+  void set_buffer_reserve(size_t size) override;
   bool send_triggered_action(int action) override;
   bool send_virtual_key_state(Key key, KeyState state) override;
   bool send_next_key_info(const std::vector<Key>& keys, const DeviceDesc& device_desc) override;
+  bool send_statistics(const std::string& statistics) override;
+  bool send_mapping_profile(
+    const std::vector<Stage::ContextProfile>& context_profiles) override;
+  bool send_trace(const std::vector<TraceRecord>& records) override;
   bool read_messages(MessageHandler& handler, 
     std::optional<Duration> timeout) override;
 
 private:
+  // identifies a serialized configuration by its hash and size
+  struct ConfigurationId {
+    uint64_t hash;
+    uint64_t size;
+
+    bool operator==(const ConfigurationId& b) const {
+      return (hash == b.hash && size == b.size);
+    }
+    bool operator!=(const ConfigurationId& b) const {
+      return !(*this == b);
+    }
+  };
+
+  // deserialized configuration, from which stages can be created
+  struct CachedConfiguration {
+    ConfigurationId id;
+    std::vector<GrabDeviceFilter> grab_device_filters;
+    std::vector<std::vector<Stage::Context>> stage_contexts;
+    std::vector<std::string> directives;
+  };
+
   const std::vector<int>& read_active_contexts(Deserializer& d);
+  const std::vector<int>& read_active_contexts_delta(Deserializer& d);
+  void on_active_contexts_changed(MessageHandler& handler);
+  bool read_configuration_hash(MessageHandler& handler, 
+    const ConfigurationId& id);
+  bool request_configuration(const ConfigurationId& id, bool allow_shared);
+  bool read_configuration(MessageHandler& handler, 
+    const ConfigurationId& id, Deserializer& d);
+  void cancel_configuration_request(MessageHandler& handler);
+#if defined(__linux__)
+  bool read_shared_configuration(MessageHandler& handler, 
+    const ConfigurationId& id);
+#endif
+  void apply_configuration(MessageHandler& handler,
+    const CachedConfiguration& configuration);
 
   Host m_host;
   Connection m_connection;
+  size_t m_buffer_reserve{ };
   std::vector<int> m_active_context_indices;
+  std::vector<int> m_removed_context_indices;
+  std::vector<int> m_added_context_indices;
+  // most recently used first
+  std::vector<CachedConfiguration> m_configuration_cache;
+  std::optional<ConfigurationId> m_requested_configuration;
+  bool m_active_contexts_pending{ };
 };
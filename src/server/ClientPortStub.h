@@ -0,0 +1,22 @@
+#pragma once
+
+#include "ClientPort.h"
+
+// a client port without a connection, for running the server state offline
+class ClientPortStub : public IClientPort {
+public:
+  Socket socket() const override { return invalid_socket; }
+  Socket listen_socket() const override { return invalid_socket; }
+  bool version_mismatch() const override { return false; }
+  bool listen() override { return false; }
+  bool accept() override { return false; }
+  void disconnect() override { }
+  void set_buffer_reserve(size_t size) override { }
+  bool send_triggered_action(int action) override { return true; }
+  bool send_virtual_key_state(Key key, KeyState state) override { return true; }
+  bool send_next_key_info(const std::vector<Key>& keys, const DeviceDesc& device_desc) override { return true; }
+  bool send_statistics(const std::string& statistics) override { return true; }
+  bool send_mapping_profile(const std::vector<Stage::ContextProfile>& context_profiles) override { return true; }
+  bool send_trace(const std::vector<TraceRecord>& records) override { return true; }
+  bool read_messages(MessageHandler& handler, std::optional<Duration> timeout) override { return true; }
+};
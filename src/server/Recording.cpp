@@ -0,0 +1,156 @@
+
+#include "Recording.h"
+#include <cstring>
+
+namespace {
+  const char file_magic[8] = "kmrec";
+  const auto file_version = uint32_t{ 1 };
+
+  class Reader {
+  public:
+    explicit Reader(std::FILE* file) : m_file(file) { }
+
+    template<typename T>
+    bool read(T* value) {
+      return (std::fread(value, sizeof(T), 1, m_file) == 1);
+    }
+
+    bool read(std::string* string) {
+      auto size = uint32_t{ };
+      if (!read(&size))
+        return false;
+      string->resize(size);
+      return (std::fread(string->data(), 1, size, m_file) == size);
+    }
+
+  private:
+    std::FILE* m_file;
+  };
+} // namespace
+
+RecordingWriter::~RecordingWriter() {
+  if (m_file)
+    std::fclose(m_file);
+}
+
+bool RecordingWriter::open(const std::string& filename) {
+  if (m_file)
+    std::fclose(m_file);
+  m_file = std::fopen(filename.c_str(), "wb");
+  if (!m_file)
+    return false;
+  m_begin = Clock::now();
+  std::fwrite(file_magic, sizeof(file_magic), 1, m_file);
+  write(file_version);
+  return true;
+}
+
+template<typename T>
+void RecordingWriter::write(const T& value) {
+  std::fwrite(&value, sizeof(T), 1, m_file);
+}
+
+void RecordingWriter::write(const std::string& string) {
+  write(static_cast<uint32_t>(string.size()));
+  std::fwrite(string.data(), 1, string.size(), m_file);
+}
+
+void RecordingWriter::write_header(RecordedEvent::Type type, Clock::time_point time) {
+  write(type);
+  write(static_cast<int64_t>(std::chrono::duration_cast<
+    std::chrono::nanoseconds>(time - m_begin).count()));
+}
+
+void RecordingWriter::write_input(Clock::time_point time,
+    const KeyEvent& event, int device_index) {
+  write_header(RecordedEvent::Type::input, time);
+  write(event);
+  write(static_cast<int16_t>(device_index));
+}
+
+void RecordingWriter::write_output(const KeyEvent& event) {
+  write_header(RecordedEvent::Type::output, Clock::now());
+  write(event);
+}
+
+void RecordingWriter::write_active_contexts(const std::vector<int>& indices) {
+  write_header(RecordedEvent::Type::active_contexts, Clock::now());
+  write(static_cast<uint32_t>(indices.size()));
+  for (auto index : indices)
+    write(static_cast<uint32_t>(index));
+}
+
+void RecordingWriter::write_virtual_key_state(Key key, KeyState state) {
+  write_header(RecordedEvent::Type::virtual_key_state, Clock::now());
+  write(KeyEvent(key, state));
+}
+
+void RecordingWriter::write_device_descs(const std::vector<DeviceDesc>& device_descs) {
+  write_header(RecordedEvent::Type::device_descs, Clock::now());
+  write(static_cast<uint32_t>(device_descs.size()));
+  for (const auto& device_desc : device_descs) {
+    write(device_desc.name);
+    write(device_desc.id);
+  }
+}
+
+bool read_recording(const std::string& filename, std::vector<RecordedEvent>* events) {
+  auto file = std::fopen(filename.c_str(), "rb");
+  if (!file)
+    return false;
+
+  auto reader = Reader(file);
+  char magic[sizeof(file_magic)];
+  auto version = uint32_t{ };
+  auto succeeded = (std::fread(magic, sizeof(magic), 1, file) == 1 &&
+    std::memcmp(magic, file_magic, sizeof(magic)) == 0 &&
+    reader.read(&version) && version == file_version);
+
+  auto type = RecordedEvent::Type{ };
+  while (succeeded && reader.read(&type)) {
+    auto& event = events->emplace_back();
+    event.type = type;
+    auto time = int64_t{ };
+    succeeded = reader.read(&time);
+    event.time = std::chrono::nanoseconds(time);
+
+    switch (type) {
+      case RecordedEvent::Type::input: {
+        auto device_index = int16_t{ };
+        succeeded &= reader.read(&event.event) && reader.read(&device_index);
+        event.device_index = device_index;
+        break;
+      }
+      case RecordedEvent::Type::output:
+      case RecordedEvent::Type::virtual_key_state:
+        succeeded &= reader.read(&event.event);
+        break;
+
+      case RecordedEvent::Type::active_contexts: {
+        auto count = uint32_t{ };
+        succeeded &= reader.read(&count);
+        for (auto i = 0u; succeeded && i < count; ++i) {
+          auto index = uint32_t{ };
+          succeeded = reader.read(&index);
+          event.context_indices.push_back(static_cast<int>(index));
+        }
+        break;
+      }
+      case RecordedEvent::Type::device_descs: {
+        auto count = uint32_t{ };
+        succeeded &= reader.read(&count);
+        for (auto i = 0u; succeeded && i < count; ++i) {
+          auto& device_desc = event.device_descs.emplace_back();
+          succeeded = reader.read(&device_desc.name) &&
+                      reader.read(&device_desc.id);
+        }
+        break;
+      }
+      default:
+        succeeded = false;
+        break;
+    }
+  }
+  std::fclose(file);
+  return succeeded;
+}
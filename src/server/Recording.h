@@ -0,0 +1,54 @@
+#pragma once
+
+#include "runtime/KeyEvent.h"
+#include "common/Duration.h"
+#include "common/DeviceDesc.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// an input event or message, which was processed by ServerState
+struct RecordedEvent {
+  enum class Type : uint8_t {
+    input,
+    output,
+    active_contexts,
+    virtual_key_state,
+    device_descs,
+  };
+
+  Type type;
+  // since the recording was started
+  std::chrono::nanoseconds time;
+  KeyEvent event;
+  int device_index;
+  std::vector<int> context_indices;
+  std::vector<DeviceDesc> device_descs;
+};
+
+// writes a compact binary recording, which can be replayed by replay-keymapper
+class RecordingWriter {
+public:
+  RecordingWriter() = default;
+  RecordingWriter(const RecordingWriter&) = delete;
+  RecordingWriter& operator=(const RecordingWriter&) = delete;
+  ~RecordingWriter();
+
+  bool open(const std::string& filename);
+  void write_input(Clock::time_point time, const KeyEvent& event, int device_index);
+  void write_output(const KeyEvent& event);
+  void write_active_contexts(const std::vector<int>& indices);
+  void write_virtual_key_state(Key key, KeyState state);
+  void write_device_descs(const std::vector<DeviceDesc>& device_descs);
+
+private:
+  template<typename T>
+  void write(const T& value);
+  void write(const std::string& string);
+  void write_header(RecordedEvent::Type type, Clock::time_point time);
+
+  std::FILE* m_file{ };
+  Clock::time_point m_begin;
+};
+
+bool read_recording(const std::string& filename, std::vector<RecordedEvent>* events);
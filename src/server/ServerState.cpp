@@ -23,11 +23,16 @@ void ServerState::on_directives_message(const std::vector<std::string>& directiv
   if (is_enabled("disable-virtual-keys-toggle"))
     for (const auto& stage : m_stage->stages())
       stage->set_virtual_keys_toggle(false);
+
+  if (is_enabled("profile-mappings"))
+    set_profiling(true);
 }
 
 void ServerState::on_active_contexts_message(
     const std::vector<int>& active_contexts) {
   verbose("Active contexts received (%u)", active_contexts.size());
+  if (m_recording)
+    m_recording->write_active_contexts(active_contexts);
   set_active_contexts(active_contexts);
 }
 
@@ -40,6 +45,8 @@ void ServerState::set_active_contexts(const std::vector<int>& active_contexts) {
 }
 
 void ServerState::on_set_virtual_key_state_message(Key key, KeyState state) {
+  if (m_recording)
+    m_recording->write_virtual_key_state(key, state);
   set_virtual_key_state(key, state);
   if (!m_flush_scheduled_at)
     flush_send_buffer();
@@ -57,6 +64,45 @@ void ServerState::on_request_next_key_info_message() {
   m_next_key_info_requested = true;
 }
 
+void ServerState::on_request_statistics_message() {
+  m_client->send_statistics(m_statistics->format());
+}
+
+void ServerState::on_request_mapping_profile_message(bool start) {
+  if (start)
+    set_profiling(true);
+
+  // send profiles of all stages, to match the contexts of the configuration
+  auto context_profiles = std::vector<Stage::ContextProfile>();
+  for (const auto& stage : m_stage->stages())
+    for (const auto& context_profile : stage->profile())
+      context_profiles.push_back(context_profile);
+  m_client->send_mapping_profile(context_profiles);
+}
+
+void ServerState::on_request_trace_message(bool start) {
+  if (start)
+    set_tracing(true);
+  m_client->send_trace(m_trace ? m_trace->records() : std::vector<TraceRecord>());
+}
+
+void ServerState::set_tracing(bool enabled) {
+  const auto trace_capacity = size_t{ 8192 };
+  verbose("Tracing %s", (enabled ? "started" : "stopped"));
+  m_trace = (enabled ? std::make_unique<TraceBuffer>(trace_capacity) : nullptr);
+  set_stage_traces();
+}
+
+void ServerState::set_recording(std::unique_ptr<RecordingWriter> recording) {
+  m_recording = std::move(recording);
+}
+
+void ServerState::set_stage_traces() {
+  auto stage_index = 0;
+  for (const auto& stage : m_stage->stages())
+    stage->set_trace(m_trace.get(), stage_index++);
+}
+
 void ServerState::on_inject_input_message(const KeySequence& sequence) {
   for (const auto& event : sequence)
     if ((event.state == KeyState::Up || event.state == KeyState::Down) &&
@@ -118,13 +164,32 @@ void ServerState::reset_configuration(std::unique_ptr<MultiStage> stage) {
   flush_send_buffer();
   verbose("Resetting configuration");
   m_stage = (stage ? std::move(stage) : std::make_unique<MultiStage>());
+  m_stage->reserve_buffers(m_buffer_reserve);
+  set_stage_traces();
+  // the profile is indexed by the contexts, so it restarts with the configuration
+  if (m_profiling)
+    verbose("Profiling mappings restarted");
+  set_stage_profiling();
   m_virtual_keys_down.clear();
   m_flush_scheduled_at.reset();
   m_timeout_start_at.reset();
   evaluate_device_filters();
 }
 
+void ServerState::set_profiling(bool enabled) {
+  verbose("Profiling mappings %s", (enabled ? "started" : "stopped"));
+  m_profiling = enabled;
+  set_stage_profiling();
+}
+
+void ServerState::set_stage_profiling() {
+  for (const auto& stage : m_stage->stages())
+    stage->set_profiling(m_profiling);
+}
+
 void ServerState::set_device_descs(std::vector<DeviceDesc> device_descs) {
+  if (m_recording)
+    m_recording->write_device_descs(device_descs);
   m_device_descs = std::move(device_descs);
   evaluate_device_filters();
 }
@@ -140,6 +205,14 @@ void ServerState::evaluate_device_filters() {
   set_active_contexts(m_stage->active_client_contexts());
 }
 
+// prevent allocations while processing input
+void ServerState::set_buffer_reserve(size_t size) {
+  m_buffer_reserve = size;
+  m_send_buffer.reserve(size);
+  m_stage->reserve_buffers(size);
+  m_client->set_buffer_reserve(size);
+}
+
 bool ServerState::has_configuration() const {
   return !m_stage->stages().empty();
 }
@@ -168,12 +241,12 @@ void ServerState::set_virtual_key_state(Key key, KeyState state) {
   if (it == m_virtual_keys_down.end() && state != KeyState::Up) {
     state = KeyState::Down;
     m_virtual_keys_down.push_back(key);
-    translate_input({ key, state }, Stage::any_device_index);
+    process_input({ key, state }, Stage::any_device_index, Clock::now());
   }
   else if (it != m_virtual_keys_down.end() && state != KeyState::Down) {
     state = KeyState::Up;
     m_virtual_keys_down.erase(it);
-    translate_input({ key, state }, Stage::any_device_index);
+    process_input({ key, state }, Stage::any_device_index, Clock::now());
   }
   else {
     return;
@@ -192,7 +265,54 @@ const DeviceDesc* ServerState::get_device_desc(int device_index) const {
       &m_device_descs[device_index] : nullptr);
 }
 
-bool ServerState::translate_input(KeyEvent input, int device_index) {
+bool ServerState::replay_event(const RecordedEvent& event,
+    Clock::time_point time) {
+  switch (event.type) {
+    case RecordedEvent::Type::input:
+      // the main loop cancelled the timeout before a timeout event was recorded
+      if (event.event.key == Key::timeout)
+        cancel_timeout();
+      return translate_input(event.event, event.device_index, time);
+
+    case RecordedEvent::Type::output:
+      break;
+
+    case RecordedEvent::Type::active_contexts:
+      on_active_contexts_message(event.context_indices);
+      break;
+
+    case RecordedEvent::Type::virtual_key_state:
+      on_set_virtual_key_state_message(event.event.key, event.event.state);
+      break;
+
+    case RecordedEvent::Type::device_descs:
+      set_device_descs(event.device_descs);
+      break;
+  }
+  return true;
+}
+
+bool ServerState::translate_input(KeyEvent input, int device_index,
+    Clock::time_point time) {
+  if (m_recording)
+    m_recording->write_input(time, input, device_index);
+  if (!m_trace)
+    return process_input(input, device_index, time);
+
+  const auto begin = Clock::now();
+  const auto send_buffer_size = m_send_buffer.size();
+  const auto result = process_input(input, device_index, time);
+  const auto output_count = (m_send_buffer.size() > send_buffer_size ?
+    m_send_buffer.size() - send_buffer_size : 0);
+  m_trace->add({ begin, Clock::now() - begin, input,
+    TraceRecord::Type::translate_input, -1,
+    static_cast<int16_t>(device_index), -1, -1,
+    static_cast<uint16_t>(output_count) });
+  return result;
+}
+
+bool ServerState::process_input(KeyEvent input, int device_index,
+    Clock::time_point time) {
   // ignore key repeat while a flush or a timeout is pending
   if (input == m_last_key_event && 
         (m_flush_scheduled_at || m_timeout_start_at)) {
@@ -222,11 +342,12 @@ bool ServerState::translate_input(KeyEvent input, int device_index) {
   [[maybe_unused]] auto cancelled_timeout = false;
   if (m_timeout_start_at &&
       (input.state == KeyState::Down || m_cancel_timeout_on_up)) {
-    // cancel current time out, inject event with elapsed time
-    const auto time_since_timeout_start = 
-      (Clock::now() - *m_timeout_start_at);
+    // cancel current time out, inject event with time elapsed until input occurred
+    const auto time_since_timeout_start = (time - *m_timeout_start_at);
     cancel_timeout();
-    translate_input(make_input_timeout_event(time_since_timeout_start), device_index);
+    m_statistics->increment(Statistics::Counter::timeouts_cancelled);
+    process_input(make_input_timeout_event(time_since_timeout_start), 
+      device_index, time);
     cancelled_timeout = true;
   }
 
@@ -243,12 +364,15 @@ bool ServerState::translate_input(KeyEvent input, int device_index) {
 
   // automatically insert mouse wheel Down before Up
   if (is_mouse_wheel(input.key) && input.state == KeyState::Up)
-    translate_input({ input.key, KeyState::Down, input.value }, device_index);
+    process_input({ input.key, KeyState::Down, input.value }, device_index, time);
 
   if (is_keyboard_key(input.key))
     m_last_key_event = input;
 
-  auto output = m_stage->update(input, device_index);
+  const auto update_start = Clock::now();
+  auto output = m_stage->update(input, device_index, time);
+  m_statistics->add(Statistics::Latency::translate, Clock::now() - update_start);
+  m_statistics->increment(Statistics::Counter::input_events);
 
   if (m_stage->should_exit()) {
     verbose("Read exit sequence");
@@ -262,7 +386,7 @@ bool ServerState::translate_input(KeyEvent input, int device_index) {
     const auto& request = output.back();
     schedule_timeout(
       timeout_to_milliseconds(request.value), 
-      cancel_timeout_on_up(request.state));
+      cancel_timeout_on_up(request.state), time);
     output.pop_back();
   }
 
@@ -315,7 +439,12 @@ bool ServerState::flush_send_buffer() {
   if (m_sending_key)
     return true;
   m_sending_key = true;
-  m_flush_scheduled_at.reset();
+  const auto start_time = Clock::now();
+  if (m_flush_scheduled_at) {
+    m_statistics->add(Statistics::Latency::scheduled,
+      start_time - m_flush_scheduled_time);
+    m_flush_scheduled_at.reset();
+  }
 
   auto succeeded = true;
   auto i = size_t{ };
@@ -363,14 +492,24 @@ bool ServerState::flush_send_buffer() {
     }
 #endif
 
+    if (m_recording)
+      m_recording->write_output(event);
     if (!on_send_key(event)) {
       succeeded = false;
       break;
     }
+    m_statistics->increment(Statistics::Counter::output_events);
   }
   
   if (!on_flushed_send_buffer())
     succeeded = false;
+  if (i > 0) {
+    const auto duration = Clock::now() - start_time;
+    m_statistics->add(Statistics::Latency::flush, duration);
+    if (m_trace)
+      m_trace->add({ start_time, duration, { },
+        TraceRecord::Type::flush, -1, -1, -1, -1, static_cast<uint16_t>(i) });
+  }
   m_send_buffer.erase(m_send_buffer.begin(), m_send_buffer.begin() + i);
   m_sending_key = false;
   return succeeded;
@@ -379,8 +518,10 @@ bool ServerState::flush_send_buffer() {
 void ServerState::schedule_flush(Duration delay) {
   if (m_flush_scheduled_at)
     return;
-  m_flush_scheduled_at = Clock::now() + 
+  m_flush_scheduled_time = Clock::now();
+  m_flush_scheduled_at = m_flush_scheduled_time + 
     std::chrono::duration_cast<Clock::duration>(delay);
+  m_statistics->increment(Statistics::Counter::flushes_scheduled);
   on_flush_scheduled(delay);
 }
 
@@ -388,10 +529,12 @@ std::optional<Clock::time_point> ServerState::flush_scheduled_at() const {
   return m_flush_scheduled_at;
 }
 
-void ServerState::schedule_timeout(Duration timeout, bool cancel_on_up) {
+void ServerState::schedule_timeout(Duration timeout, bool cancel_on_up,
+    Clock::time_point time) {
   m_timeout = timeout;
-  m_timeout_start_at = Clock::now();
+  m_timeout_start_at = time;
   m_cancel_timeout_on_up = cancel_on_up;
+  m_statistics->increment(Statistics::Counter::timeouts_scheduled);
   on_timeout_scheduled(timeout);
 }
 
@@ -1,6 +1,8 @@
 #pragma once
 
 #include "ClientPort.h"
+#include "Statistics.h"
+#include "Recording.h"
 #include "runtime/Stage.h"
 
 class ServerState : public ClientPort::MessageHandler {
@@ -13,13 +15,19 @@ public:
   void disconnect();
   bool read_client_messages(std::optional<Duration> timeout = { });
   void reset_configuration(std::unique_ptr<MultiStage> stage = { });
+  void set_buffer_reserve(size_t size);
   bool has_configuration() const;
   bool has_active_client_context() const;
   bool has_mouse_mappings() const;
   bool has_device_filters() const;
   void set_device_descs(std::vector<DeviceDesc> device_descs);
   bool should_exit() const;
-  bool translate_input(KeyEvent input, int device_index);
+  bool translate_input(KeyEvent input, int device_index,
+    Clock::time_point time = Clock::now());
+  void set_tracing(bool enabled);
+  void set_recording(std::unique_ptr<RecordingWriter> recording);
+  // returns false when an input event was not translated
+  bool replay_event(const RecordedEvent& event, Clock::time_point time);
   bool send_buffer_has_mouse_events() const;
   bool flush_send_buffer();
   bool sending_key() const { return m_sending_key; }
@@ -30,6 +38,7 @@ public:
   std::optional<Clock::time_point> timeout_start_at() const;
   Duration timeout() const;
   void cancel_timeout();
+  Statistics& statistics() { return *m_statistics; }
 
 protected:
   void on_configuration_message(std::unique_ptr<MultiStage> stage) override;
@@ -39,6 +48,9 @@ protected:
   void on_set_virtual_key_state_message(Key key, KeyState state) override;
   void on_validate_state_message() override;
   void on_request_next_key_info_message() override;
+  void on_request_statistics_message() override;
+  void on_request_mapping_profile_message(bool start) override;
+  void on_request_trace_message(bool start) override;
   void on_inject_input_message(const KeySequence& sequence) override;
   void on_inject_output_message(const KeySequence& sequence) override;
 
@@ -54,25 +66,38 @@ protected:
   void release_all_keys();
   void set_active_contexts(const std::vector<int>& active_contexts);
   void send_key_sequence(const KeySequence& key_sequence);
-  void schedule_timeout(Duration timeout, bool cancel_on_up);
+  void schedule_timeout(Duration timeout, bool cancel_on_up,
+    Clock::time_point time);
   void set_virtual_key_state(Key key, KeyState state);
   void toggle_virtual_key(Key key);
   void evaluate_device_filters();
+  void set_profiling(bool enabled);
   const DeviceDesc* get_device_desc(int device_index) const;
 
 private:
+  bool process_input(KeyEvent input, int device_index,
+    Clock::time_point time);
+  void set_stage_traces();
+  void set_stage_profiling();
+
   std::unique_ptr<IClientPort> m_client;
   std::unique_ptr<MultiStage> m_stage;
   std::vector<KeyEvent> m_send_buffer;
+  size_t m_buffer_reserve{ };
   std::vector<Key> m_virtual_keys_down;
   KeyEvent m_last_key_event;
   bool m_sending_key{ };
   int m_insert_in_send_buffer_at{ -1 };
   std::optional<Clock::time_point> m_flush_scheduled_at;
+  Clock::time_point m_flush_scheduled_time;
   std::optional<Clock::time_point> m_timeout_start_at;
   Duration m_timeout{ };
   bool m_cancel_timeout_on_up{ };
   std::vector<DeviceDesc> m_device_descs;
   bool m_next_key_info_requested{ };
   std::vector<Key> m_next_key_info;
+  std::unique_ptr<Statistics> m_statistics{ std::make_unique<Statistics>() };
+  std::unique_ptr<TraceBuffer> m_trace;
+  bool m_profiling{ };
+  std::unique_ptr<RecordingWriter> m_recording;
 };
@@ -1,6 +1,22 @@
 
 #include "Settings.h"
 #include "common/output.h"
+#include <cstdlib>
+
+#if defined(__linux__)
+# include <sched.h>
+
+namespace {
+  // returns -1 when string is not a CPU which can be pinned to
+  int to_cpu_index(const char* string) {
+    auto end = static_cast<char*>(nullptr);
+    const auto value = std::strtol(string, &end, 10);
+    if (end == string || *end != '\0' || value < 0 || value >= CPU_SETSIZE)
+      return -1;
+    return static_cast<int>(value);
+  }
+} // namespace
+#endif
 
 #if defined(_WIN32)
 bool interpret_commandline(Settings& settings, int argc, wchar_t* argv[]) {
@@ -17,6 +33,33 @@ bool interpret_commandline(Settings& settings, int argc, char* argv[]) {
     if (argument == T("-v") || argument == T("--verbose")) {
       settings.verbose = true;
     }
+#if defined(__linux__)
+    else if (argument == T("-p") || argument == T("--pipelined")) {
+      settings.pipelined = true;
+    }
+    else if (argument == T("--io-uring")) {
+      settings.io_uring = true;
+    }
+    else if (argument == T("--realtime")) {
+      settings.realtime = true;
+    }
+    else if (argument == T("--realtime-cpu")) {
+      if (++i >= argc)
+        return false;
+      const auto cpu = to_cpu_index(argv[i]);
+      if (cpu < 0)
+        return false;
+      settings.realtime = true;
+      settings.realtime_cpu = cpu;
+    }
+#endif
+#if !defined(_WIN32)
+    else if (argument == T("--record")) {
+      if (++i >= argc)
+        return false;
+      settings.record_filename = argv[i];
+    }
+#endif
 #if defined(__APPLE__)
     else if (argument == T("-g")) {
       settings.grab_and_exit = true;
@@ -35,6 +78,15 @@ void print_help_message() {
     "\n"
     "Usage: keymapperd [-options]\n"
     "  -v, --verbose        enable verbose output.\n"
+#if defined(__linux__)
+    "  -p, --pipelined      read and write devices in separate threads.\n"
+    "  --io-uring           read and write devices using io_uring.\n"
+    "  --realtime           use realtime scheduling and lock memory.\n"
+    "  --realtime-cpu N     like --realtime, pinned to CPU N.\n"
+#endif
+#if !defined(_WIN32)
+    "  --record \"file\"      record input for replay-keymapper.\n"
+#endif
     "  -h, --help           print this help.\n"
     "\n"
     "%s\n"
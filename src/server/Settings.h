@@ -1,10 +1,16 @@
 #pragma once
 
 #include <string>
+#include <optional>
 
 struct Settings {
   bool verbose;
   bool grab_and_exit;
+  bool pipelined;
+  bool io_uring;
+  bool realtime;
+  std::optional<int> realtime_cpu;
+  std::string record_filename;
 };
 
 #if defined(_WIN32)
@@ -0,0 +1,128 @@
+
+#include "Statistics.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+  const char* get_latency_name(Statistics::Latency latency) {
+    switch (latency) {
+      case Statistics::Latency::read: return "read";
+      case Statistics::Latency::translate: return "translate";
+      case Statistics::Latency::flush: return "flush";
+      case Statistics::Latency::scheduled: return "scheduled";
+      case Statistics::Latency::output: return "output";
+      case Statistics::Latency::count: break;
+    }
+    return "";
+  }
+
+  const char* get_counter_name(Statistics::Counter counter) {
+    switch (counter) {
+      case Statistics::Counter::input_events: return "input events";
+      case Statistics::Counter::output_events: return "output events";
+      case Statistics::Counter::timeouts_scheduled: return "timeouts scheduled";
+      case Statistics::Counter::timeouts_cancelled: return "timeouts cancelled";
+      case Statistics::Counter::timeouts_fired: return "timeouts fired";
+      case Statistics::Counter::flushes_scheduled: return "flushes scheduled";
+      case Statistics::Counter::count: break;
+    }
+    return "";
+  }
+
+  double to_milliseconds(Duration duration) {
+    return duration.count() * 1000.0;
+  }
+} // namespace
+
+int LatencyHistogram::get_bucket(uint32_t microseconds) {
+  if (microseconds < 4)
+    return static_cast<int>(microseconds);
+  auto msb = 0;
+  while (microseconds >> (msb + 1))
+    ++msb;
+  return (msb - 1) * 4 + static_cast<int>((microseconds >> (msb - 2)) & 3);
+}
+
+uint32_t LatencyHistogram::get_bucket_upper_bound(int bucket) {
+  if (bucket < 4)
+    return static_cast<uint32_t>(bucket);
+  const auto msb = bucket / 4 + 1;
+  const auto sub_bucket = static_cast<uint32_t>(bucket % 4);
+  return ((4 + sub_bucket + 1) << (msb - 2)) - 1;
+}
+
+void LatencyHistogram::add(Duration duration) {
+  const auto microseconds = static_cast<uint32_t>(std::clamp(
+    duration.count() * 1'000'000.0, 0.0, 4'294'967'295.0));
+  m_buckets[get_bucket(microseconds)].fetch_add(1, std::memory_order_relaxed);
+  m_count.fetch_add(1, std::memory_order_relaxed);
+
+  auto max = m_max.load(std::memory_order_relaxed);
+  while (microseconds > max &&
+         !m_max.compare_exchange_weak(max, microseconds, std::memory_order_relaxed));
+}
+
+uint64_t LatencyHistogram::count() const {
+  return m_count.load(std::memory_order_relaxed);
+}
+
+Duration LatencyHistogram::percentile(double fraction) const {
+  const auto total = count();
+  if (!total)
+    return { };
+  const auto rank = std::max(uint64_t{ 1 },
+    static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(total))));
+  auto sum = uint64_t{ };
+  for (auto i = 0; i < bucket_count; ++i) {
+    sum += m_buckets[i].load(std::memory_order_relaxed);
+    if (sum >= rank)
+      return std::min(max(), Duration(get_bucket_upper_bound(i) / 1'000'000.0));
+  }
+  return max();
+}
+
+Duration LatencyHistogram::max() const {
+  return Duration(m_max.load(std::memory_order_relaxed) / 1'000'000.0);
+}
+
+void Statistics::add(Latency latency, Duration duration) {
+  m_latencies[static_cast<size_t>(latency)].add(duration);
+}
+
+void Statistics::increment(Counter counter) {
+  m_counters[static_cast<size_t>(counter)].fetch_add(1, std::memory_order_relaxed);
+}
+
+const LatencyHistogram& Statistics::latency(Latency latency) const {
+  return m_latencies[static_cast<size_t>(latency)];
+}
+
+uint64_t Statistics::counter(Counter counter) const {
+  return m_counters[static_cast<size_t>(counter)].load(std::memory_order_relaxed);
+}
+
+std::string Statistics::format() const {
+  auto result = std::string();
+  char line[128];
+  std::snprintf(line, sizeof(line), "%-10s %10s %10s %10s %10s\n",
+    "latency", "count", "p50", "p99", "max");
+  result += line;
+  for (auto i = 0; i < static_cast<int>(Latency::count); ++i) {
+    const auto& histogram = m_latencies[i];
+    std::snprintf(line, sizeof(line), "%-10s %10llu %8.3fms %8.3fms %8.3fms\n",
+      get_latency_name(static_cast<Latency>(i)),
+      static_cast<unsigned long long>(histogram.count()),
+      to_milliseconds(histogram.percentile(0.5)),
+      to_milliseconds(histogram.percentile(0.99)),
+      to_milliseconds(histogram.max()));
+    result += line;
+  }
+  for (auto i = 0; i < static_cast<int>(Counter::count); ++i) {
+    std::snprintf(line, sizeof(line), "%s: %llu\n",
+      get_counter_name(static_cast<Counter>(i)),
+      static_cast<unsigned long long>(counter(static_cast<Counter>(i))));
+    result += line;
+  }
+  return result;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "common/Duration.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// lock-free, so it can be updated by the threads of the pipelined mode
+class LatencyHistogram {
+public:
+  void add(Duration duration);
+  uint64_t count() const;
+  Duration percentile(double fraction) const;
+  Duration max() const;
+
+private:
+  // four buckets per power of two microseconds
+  static constexpr int bucket_count = 124;
+  static int get_bucket(uint32_t microseconds);
+  static uint32_t get_bucket_upper_bound(int bucket);
+
+  std::array<std::atomic<uint32_t>, bucket_count> m_buckets{ };
+  std::atomic<uint64_t> m_count{ };
+  std::atomic<uint32_t> m_max{ };
+};
+
+class Statistics {
+public:
+  enum class Latency {
+    read,      // from event time until it was read
+    translate, // matching input in stages
+    flush,     // sending buffered output
+    scheduled, // from scheduling a flush until it was performed
+    output,    // from event time until its output was written
+    count
+  };
+
+  enum class Counter {
+    input_events,
+    output_events,
+    timeouts_scheduled,
+    timeouts_cancelled,
+    timeouts_fired,
+    flushes_scheduled,
+    count
+  };
+
+  void add(Latency latency, Duration duration);
+  void increment(Counter counter);
+  const LatencyHistogram& latency(Latency latency) const;
+  uint64_t counter(Counter counter) const;
+  std::string format() const;
+
+private:
+  std::array<LatencyHistogram, static_cast<size_t>(Latency::count)> m_latencies;
+  std::array<std::atomic<uint64_t>, static_cast<size_t>(Counter::count)> m_counters{ };
+};
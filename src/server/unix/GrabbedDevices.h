@@ -18,6 +18,7 @@ public:
     int type;
     int code;
     int value;
+    std::chrono::steady_clock::time_point time;
   };
 
   GrabbedDevices();
@@ -27,6 +28,10 @@ public:
 
   bool grab(bool grab_mice, std::vector<GrabDeviceFilter> grab_filters);
   bool update_devices();
+#if defined(__linux__)
+  // reads using io_uring instead of select, set before grabbing devices
+  void set_io_uring(class IoUring* io_uring);
+#endif
   std::pair<bool, std::optional<Event>> read_input_event(
     std::optional<Duration> timeout, int interrupt_fd);
   const std::vector<DeviceDesc>& grabbed_device_descs() const;
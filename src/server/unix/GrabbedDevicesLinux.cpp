@@ -11,7 +11,12 @@
 #include <bitset>
 #include <iterator>
 #include <filesystem>
+#include <map>
+#include <cstring>
+#include <atomic>
+#include <thread>
 #include <fcntl.h>
+#include <poll.h>
 #include <unistd.h>
 
 #if defined(__FreeBSD__)
@@ -20,6 +25,10 @@
 # include <linux/input.h>
 #endif
 
+#if defined(__linux__)
+# include "IoUring.h"
+#endif
+
 #if __has_include(<sys/inotify.h>)
 # include <sys/inotify.h>
 # define ENABLE_DEVICE_MONITOR
@@ -34,6 +43,8 @@ namespace {
   };
 
   constexpr auto default_abs_range = IntRange{ 0, 1023 };
+  constexpr auto read_buffer_size = size_t{ 64 };
+  constexpr auto key_release_timeout = std::chrono::seconds(5);
 
   template<uint64_t Value> uint64_t bit = (1ull << Value);
 
@@ -148,7 +159,9 @@ namespace {
     return "";
   }
 
-  std::string get_device_input_id(int event_id) {
+  // maps event ids to the names of their symlinks in /dev/input/by-id
+  std::map<int, std::string> get_device_input_ids() {
+    auto input_ids = std::map<int, std::string>();
     auto ec = std::error_code{ };
     for (auto const& entry : std::filesystem::directory_iterator("/dev/input/by-id", ec)) {
       auto target_event_id = 0;
@@ -159,10 +172,9 @@ namespace {
       if (::sscanf(target_path.c_str(), "../event%d", &target_event_id) != 1)
         continue;
 
-      if (target_event_id == event_id)
-        return entry.path().filename();
+      input_ids.emplace(target_event_id, entry.path().filename());
     }
-    return { };
+    return input_ids;
   }
 
   input_id get_device_ids(int fd) {
@@ -252,23 +264,67 @@ namespace {
     return axes;
   }
 
-  bool wait_until_keys_released(int fd) {
-    const auto retries = 1000;
-    const auto sleep_ms = 5;
-    for (auto i = 0; i < retries; ++i) {
-      auto bits = std::array<char, (KEY_MAX + 7) / 8>();
-      if (ioctl(fd, EVIOCGKEY(bits.size()), bits.data()) == -1)
+  bool all_keys_released(int fd) {
+    auto bits = std::array<char, (KEY_MAX + 7) / 8>();
+    if (ioctl(fd, EVIOCGKEY(bits.size()), bits.data()) == -1)
+      return true;
+
+    return std::none_of(std::cbegin(bits), std::cend(bits),
+      [](char bits) { return (bits != 0); });
+  }
+
+  void discard_pending_events(int fd) {
+    auto events = std::array<input_event, 64>();
+    while (::read(fd, events.data(), sizeof(events)) == -1 && errno == EINTR)
+      continue;
+  }
+
+  // waits for events of all devices until no more key is down on any of them
+  bool wait_until_keys_released(const std::vector<int>& fds) {
+    const auto deadline = Clock::now() + key_release_timeout;
+    auto pending = std::vector<pollfd>();
+    for (auto fd : fds)
+      if (!all_keys_released(fd))
+        pending.push_back({ fd, POLLIN, 0 });
+
+    while (!pending.empty()) {
+      const auto timeout_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        deadline - Clock::now()).count();
+      if (timeout_ms <= 0)
         return false;
 
-      const auto all_keys_released =
-        std::none_of(std::cbegin(bits), std::cend(bits),
-          [](char bits) { return (bits != 0); });
-      if (all_keys_released)
-        return true;
+      const auto result = ::poll(pending.data(), pending.size(), 
+        static_cast<int>(timeout_ms));
+      if (result == -1 && errno == EINTR)
+        continue;
+      if (result < 0)
+        return false;
 
-      ::usleep(sleep_ms * 1000);
+      for (auto& device : pending) {
+        if (device.revents & POLLIN)
+          discard_pending_events(device.fd);
+
+        if ((device.revents & (POLLERR | POLLHUP | POLLNVAL)) ||
+            all_keys_released(device.fd))
+          device.fd = -1;
+      }
+      pending.erase(std::remove_if(pending.begin(), pending.end(),
+        [](const pollfd& device) { return device.fd < 0; }), pending.end());
     }
-    return false;
+    return true;
+  }
+
+  // let device report event times using the clock of std::chrono::steady_clock
+  bool set_monotonic_clock(int fd) {
+    auto clock_id = int{ CLOCK_MONOTONIC };
+    return (ioctl(fd, EVIOCSCLOCKID, &clock_id) == 0);
+  }
+
+  std::chrono::steady_clock::time_point get_event_time(const input_event& event) {
+    return std::chrono::steady_clock::time_point(
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::seconds(event.input_event_sec) +
+        std::chrono::microseconds(event.input_event_usec)));
   }
 
   bool grab_event_device(int fd, bool grab) {
@@ -287,7 +343,7 @@ namespace {
 
   int create_event_device_monitor() {
 #if defined(ENABLE_DEVICE_MONITOR)
-    auto fd = ::inotify_init();
+    auto fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
     if (fd >= 0) {
       auto ret = ::inotify_add_watch(fd, "/dev/input", IN_CREATE | IN_DELETE);
       if (ret == -1) {
@@ -301,17 +357,42 @@ namespace {
 #endif
   }
 
-  bool read_all(int fd, char* buffer, size_t length) {
-    while (length != 0) {
-      auto ret = ::read(fd, buffer, length);
-      if (ret == -1 && errno == EINTR)
+  int add_device_input_ids_watch(int monitor_fd) {
+#if defined(ENABLE_DEVICE_MONITOR)
+    // directory does not exist until udev created the first symlink
+    return ::inotify_add_watch(monitor_fd, "/dev/input/by-id", IN_CREATE | IN_DELETE);
+#else
+    return -1;
+#endif
+  }
+
+  // calls function for each index in [0, count) on a few threads
+  template<typename F>
+  void for_each_parallel(size_t count, F&& function) {
+    const auto max_threads = size_t{ 8 };
+    auto next_index = std::atomic<size_t>{ };
+    const auto worker = [&]() {
+      for (auto index = next_index++; index < count; index = next_index++)
+        function(index);
+    };
+    auto threads = std::vector<std::thread>();
+    for (auto i = size_t{ 1 }; i < std::min(count, max_threads); ++i)
+      threads.emplace_back(worker);
+    worker();
+    for (auto& thread : threads)
+      thread.join();
+  }
+
+  // reads all pending events with a single call, evdev only returns complete events
+  int read_events(int fd, input_event* events, size_t max_count) {
+    for (;;) {
+      const auto result = ::read(fd, events, max_count * sizeof(input_event));
+      if (result == -1 && errno == EINTR)
         continue;
-      if (ret <= 0)
-        return false;
-      length -= static_cast<size_t>(ret);
-      buffer += ret;
+      if (result < static_cast<ssize_t>(sizeof(input_event)))
+        return -1;
+      return static_cast<int>(static_cast<size_t>(result) / sizeof(input_event));
     }
-    return true;
   }
 } // namespace
 
@@ -325,43 +406,131 @@ private:
     IntRange abs_range_volume;
     IntRange abs_range_misc;
     bool has_highres_wheel;
-    bool disappeared;
+    bool has_monotonic_time;
+    DeviceDesc desc;
+  };
+
+  struct ProbedDevice {
+    int event_id;
+    std::string path;
+    int fd;
+    int error;
+    std::string name;
+    bool supported;
+    bool grab;
+    DeviceDesc desc;
+  };
+
+  // a device, whose (un)grabbing waits until its keys were released
+  struct DeferredDevice {
+    ProbedDevice device;
+    Clock::time_point deadline;
+    bool released;
+    uint64_t release_poll;
   };
 
   std::string_view m_ignore_device_name;
   bool m_grab_mice{ };
   std::vector<GrabDeviceFilter> m_grab_filters;
   int m_device_monitor_fd{ -1 };
+  int m_device_input_ids_watch{ -1 };
+  std::map<int, std::string> m_device_input_ids;
   std::vector<Device> m_grabbed_devices;
   std::vector<DeviceDesc> m_grabbed_device_descs;
-  bool m_devices_changed{ };
+  std::vector<int> m_changed_event_ids;
+  bool m_device_input_ids_changed{ };
+  bool m_rescan_devices{ };
+  std::vector<DeferredDevice> m_deferred_devices;
+  bool m_deferred_devices_released{ };
+  std::array<input_event, read_buffer_size> m_read_buffer;
+  const input_event* m_read_events{ };
+  int m_read_event_id{ };
+  int m_read_position{ };
+  int m_read_count{ };
+
+#if defined(__linux__)
+  // a read, which is kept armed for each grabbed device
+  struct PendingRead {
+    int event_id;
+    int fd;
+    bool cancelled;
+    std::array<input_event, read_buffer_size> buffer;
+  };
+
+  enum PollType : uint64_t { monitor_poll = 2, interrupt_poll = 3, release_poll = 4 };
+
+  IoUring* m_io_uring{ };
+  std::vector<std::unique_ptr<PendingRead>> m_pending_reads;
+  // the read whose events are returned, armed again once they were
+  PendingRead* m_unarmed_read{ };
+  std::vector<IoUring::Completion> m_completions;
+  size_t m_completion_position{ };
+  uint64_t m_monitor_poll{ };
+  uint64_t m_interrupt_poll{ };
+  int m_interrupt_poll_fd{ -1 };
+#endif
 
 public:
   using Event = GrabbedDevices::Event;
   using Duration = GrabbedDevices::Duration;
 
   ~GrabbedDevicesImpl() {
+#if defined(__linux__)
+    // armed reads would compete for the events while waiting
+    release_io_uring();
+#endif
+    for (auto& deferred : m_deferred_devices)
+      ::close(deferred.device.fd);
+
     if (!m_grabbed_devices.empty()) {
       verbose("Ungrabbing all devices");
+      auto fds = std::vector<int>();
+      for (const auto& device : m_grabbed_devices)
+        fds.push_back(device.fd);
+      wait_until_keys_released(fds);
+
       for (const auto& device : m_grabbed_devices)
         ungrab_device(device);
     }
     release_device_monitor();
   }
 
+#if defined(__linux__)
+  void set_io_uring(IoUring* io_uring) {
+    m_io_uring = io_uring;
+  }
+#endif
+
   bool initialize(bool grab_mice, std::vector<GrabDeviceFilter> grab_filters) {
     m_grab_mice = grab_mice;
     m_grab_filters = std::move(grab_filters);
-    update();
+    // when already initialized, only the difference is applied
+    if (m_device_monitor_fd < 0)
+      initialize_device_monitor();
+    rescan_devices();
     return true;
   }
 
   bool update_devices() {
-    if (!m_devices_changed)
+    if (std::exchange(m_rescan_devices, false)) {
+      m_changed_event_ids.clear();
+      m_device_input_ids_changed = false;
+      rescan_devices();
+      return true;
+    }
+
+    if (std::exchange(m_device_input_ids_changed, false))
+      update_device_input_ids();
+
+    auto changed = apply_released_devices();
+    if (!m_changed_event_ids.empty()) {
+      verbose("Updating devices");
+      changed |= update_devices(std::exchange(m_changed_event_ids, { }), false);
+    }
+    if (!changed)
       return false;
 
-    update();
-    m_devices_changed = false;
+    update_grabbed_device_descs();
     return true;
   }
 
@@ -371,7 +540,23 @@ public:
 
   std::pair<bool, std::optional<Event>> read_input_event(
         std::optional<Duration> timeout, int interrupt_fd) {
+#if defined(__linux__)
+    if (m_io_uring)
+      return read_input_event_io_uring(timeout, interrupt_fd);
+#endif
     for (;;) {
+      // return events which were already read
+      if (m_read_position < m_read_count) {
+        const auto& ev = m_read_events[m_read_position++];
+        if (auto event = to_event(m_read_event_id, ev))
+          return { true, event };
+        continue;
+      }
+
+      // let deferred devices be (un)grabbed
+      if (m_deferred_devices_released)
+        return { true, std::nullopt };
+
       auto read_set = fd_set{ };
       FD_ZERO(&read_set);
       auto max_fd = 0;
@@ -390,18 +575,36 @@ public:
         FD_SET(interrupt_fd, &read_set);
       }
 
-      auto timeoutval = (timeout ? to_timeval(timeout.value()) : timeval{ });
+      for (const auto& deferred : m_deferred_devices)
+        if (deferred.device.grab) {
+          max_fd = std::max(max_fd, deferred.device.fd);
+          FD_SET(deferred.device.fd, &read_set);
+        }
+
+      const auto wait_timeout = get_deferred_devices_timeout(timeout);
+      auto timeoutval = (wait_timeout ? to_timeval(wait_timeout.value()) : timeval{ });
       const auto result = ::select(max_fd + 1, &read_set,
-        nullptr, nullptr, (timeout ? &timeoutval : nullptr));
+        nullptr, nullptr, (wait_timeout ? &timeoutval : nullptr));
       if (result == -1 && errno == EINTR)
         continue;
 
       if (result < 0)
         return { false, std::nullopt };
 
+      auto deferred_device_readable = false;
+      for (const auto& deferred : m_deferred_devices)
+        if (deferred.device.grab && FD_ISSET(deferred.device.fd, &read_set)) {
+          discard_pending_events(deferred.device.fd);
+          deferred_device_readable = true;
+        }
+      if (deferred_device_readable || result == 0)
+        update_deferred_devices();
+      if (deferred_device_readable && result == 1)
+        continue;
+
       if (m_device_monitor_fd >= 0 &&
           FD_ISSET(m_device_monitor_fd, &read_set)) {
-        m_devices_changed = true;
+        read_device_monitor();
         return { true, std::nullopt };
       }
 
@@ -409,46 +612,20 @@ public:
           FD_ISSET(interrupt_fd, &read_set))
         return { true, std::nullopt };
 
-      auto device_index = 0;
-      for (const auto& device : m_grabbed_devices) {
-        if (FD_ISSET(device.fd, &read_set)) {
-          auto ev = input_event{ };
-          if (!read_all(device.fd,
-                reinterpret_cast<char*>(&ev), sizeof(input_event)))
-            return { false, std::nullopt };
-
-          if (ev.type == EV_ABS) {
-            // map from device range to default range
-            if (ev.code == ABS_VOLUME) {
-              ev.value = map_to_range(ev.value, device.abs_range_volume, default_abs_range);
-            }
-            else if (ev.code == ABS_MISC) {
-              ev.value = map_to_range(ev.value, device.abs_range_misc, default_abs_range);
-            }
-          }
-          else if (ev.type == EV_REL) {
-            if (!device.has_highres_wheel ||
-                !linux_highres_wheel_events) {
-              // convert from low- to highres wheel event (when device does not send these)
-              if (ev.code == REL_WHEEL) {
-                ev.code = REL_WHEEL_HI_RES;
-                ev.value *= 120;
-              }
-              else if (ev.code == REL_HWHEEL) {
-                ev.code = REL_HWHEEL_HI_RES;
-                ev.value *= 120;
-              }
-              else if (ev.code == REL_WHEEL_HI_RES ||
-                       ev.code == REL_HWHEEL_HI_RES) {
-                // ignore highres events when they were not enabled by directive
-                continue;
-              }
-            }
-          }
-          
-          return { true, Event{ device_index, ev.type, ev.code, ev.value } };
-        }
-        ++device_index;
+      const auto device = std::find_if(m_grabbed_devices.begin(), 
+        m_grabbed_devices.end(), [&](const Device& device) {
+          return FD_ISSET(device.fd, &read_set);
+        });
+      if (device != m_grabbed_devices.end()) {
+        const auto count = read_events(device->fd, 
+          m_read_buffer.data(), m_read_buffer.size());
+        if (count < 0)
+          return { false, std::nullopt };
+        m_read_event_id = device->event_id;
+        m_read_events = m_read_buffer.data();
+        m_read_position = 0;
+        m_read_count = count;
+        continue;
       }
       
       // timeout
@@ -457,20 +634,347 @@ public:
   }
 
 private:
+#if defined(__linux__)
+  static uint64_t get_poll_user_data(PollType type) {
+    // unique, so completions of cancelled polls are never mistaken
+    static auto s_poll_count = uint64_t{ };
+    return ((++s_poll_count << 3) | type);
+  }
+
+  static uint64_t get_read_user_data(const PendingRead& read) {
+    return reinterpret_cast<uint64_t>(&read);
+  }
+
+  std::vector<std::unique_ptr<PendingRead>>::iterator find_pending_read(
+      uint64_t user_data) {
+    return std::find_if(m_pending_reads.begin(), m_pending_reads.end(),
+      [&](const auto& read) { return get_read_user_data(*read) == user_data; });
+  }
+
+  bool arm_read(PendingRead& read) {
+    return m_io_uring->prepare_read(read.fd, read.buffer.data(),
+      sizeof(read.buffer), get_read_user_data(read));
+  }
+
+  // keeps a read armed for each device and polls the other descriptors
+  bool arm_requests(int interrupt_fd) {
+    for (const auto& device : m_grabbed_devices) {
+      const auto it = std::find_if(m_pending_reads.begin(), m_pending_reads.end(),
+        [&](const auto& read) {
+          return (read->event_id == device.event_id && !read->cancelled);
+        });
+      if (it == m_pending_reads.end() &&
+          !arm_read(*m_pending_reads.emplace_back(std::make_unique<PendingRead>(
+            PendingRead{ device.event_id, device.fd, false, { } }))))
+        return false;
+    }
+
+    if (m_device_monitor_fd >= 0 && !m_monitor_poll) {
+      m_monitor_poll = get_poll_user_data(monitor_poll);
+      if (!m_io_uring->prepare_poll(m_device_monitor_fd, m_monitor_poll))
+        return false;
+    }
+
+    // poll stays armed while the interrupt descriptor does not change
+    if (m_interrupt_poll && interrupt_fd != m_interrupt_poll_fd)
+      if (!m_io_uring->prepare_cancel(std::exchange(m_interrupt_poll, 0)))
+        return false;
+    if (interrupt_fd >= 0 && !m_interrupt_poll) {
+      m_interrupt_poll = get_poll_user_data(interrupt_poll);
+      m_interrupt_poll_fd = interrupt_fd;
+      if (!m_io_uring->prepare_poll(interrupt_fd, m_interrupt_poll))
+        return false;
+    }
+
+    // devices to grab are not read, only polled until keys are released
+    for (auto& deferred : m_deferred_devices)
+      if (deferred.device.grab && !deferred.release_poll) {
+        deferred.release_poll = get_poll_user_data(release_poll);
+        if (!m_io_uring->prepare_poll(deferred.device.fd, deferred.release_poll))
+          return false;
+      }
+    return true;
+  }
+
+  DeferredDevice* find_deferred_device(uint64_t user_data) {
+    const auto it = std::find_if(m_deferred_devices.begin(), 
+      m_deferred_devices.end(), [&](const DeferredDevice& deferred) {
+        return deferred.release_poll == user_data;
+      });
+    return (it != m_deferred_devices.end() ? &*it : nullptr);
+  }
+
+  // waits for all requests with a single io_uring_enter, which
+  // also submits the output written since the last call
+  std::pair<bool, std::optional<Event>> read_input_event_io_uring(
+        std::optional<Duration> timeout, int interrupt_fd) {
+    for (;;) {
+      // return events which were already read
+      if (m_read_position < m_read_count) {
+        const auto& ev = m_read_events[m_read_position++];
+        if (auto event = to_event(m_read_event_id, ev))
+          return { true, event };
+        continue;
+      }
+      if (auto read = std::exchange(m_unarmed_read, nullptr))
+        if (!arm_read(*read))
+          return { false, std::nullopt };
+
+      // let deferred devices be (un)grabbed
+      if (m_deferred_devices_released)
+        return { true, std::nullopt };
+
+      if (m_completion_position < m_completions.size()) {
+        const auto [user_data, result] = m_completions[m_completion_position++];
+        if (user_data == m_monitor_poll) {
+          m_monitor_poll = 0;
+          read_device_monitor();
+          return { true, std::nullopt };
+        }
+        if (user_data == m_interrupt_poll) {
+          m_interrupt_poll = 0;
+          return { true, std::nullopt };
+        }
+        if (const auto deferred = find_deferred_device(user_data)) {
+          deferred->release_poll = 0;
+          discard_pending_events(deferred->device.fd);
+          update_deferred_devices();
+          continue;
+        }
+
+        // ignore completions of cancelled requests
+        const auto it = find_pending_read(user_data);
+        if (it == m_pending_reads.end())
+          continue;
+        if (it->get()->cancelled) {
+          m_pending_reads.erase(it);
+          continue;
+        }
+        if (result < static_cast<int>(sizeof(input_event)))
+          return { false, std::nullopt };
+
+        m_unarmed_read = it->get();
+        m_read_event_id = m_unarmed_read->event_id;
+        m_read_events = m_unarmed_read->buffer.data();
+        m_read_position = 0;
+        m_read_count = result / static_cast<int>(sizeof(input_event));
+        continue;
+      }
+      m_completions.clear();
+      m_completion_position = 0;
+
+      if (!arm_requests(interrupt_fd) ||
+          !m_io_uring->submit_and_wait(
+            get_deferred_devices_timeout(timeout), &m_completions))
+        return { false, std::nullopt };
+
+      // timeout
+      if (m_completions.empty()) {
+        update_deferred_devices();
+        return { true, std::nullopt };
+      }
+    }
+  }
+
+  void cancel_read(int event_id) {
+    if (!m_io_uring)
+      return;
+    for (auto it = m_pending_reads.begin(); it != m_pending_reads.end(); ++it) {
+      auto& read = **it;
+      if (read.event_id != event_id || read.cancelled)
+        continue;
+
+      if (&read == m_unarmed_read) {
+        // not armed, can be released immediately
+        m_unarmed_read = nullptr;
+        m_read_position = m_read_count = 0;
+        m_pending_reads.erase(it);
+      }
+      else {
+        // buffer is released once the cancellation completed
+        read.cancelled = true;
+        m_io_uring->prepare_cancel(get_read_user_data(read));
+      }
+      return;
+    }
+  }
+
+  void release_io_uring() {
+    if (!m_io_uring)
+      return;
+    if (m_monitor_poll)
+      m_io_uring->prepare_cancel(std::exchange(m_monitor_poll, 0));
+    if (m_interrupt_poll)
+      m_io_uring->prepare_cancel(std::exchange(m_interrupt_poll, 0));
+    for (auto& deferred : m_deferred_devices)
+      if (deferred.release_poll)
+        m_io_uring->prepare_cancel(std::exchange(deferred.release_poll, 0));
+    if (auto read = std::exchange(m_unarmed_read, nullptr))
+      m_pending_reads.erase(find_pending_read(get_read_user_data(*read)));
+    for (const auto& read : m_pending_reads)
+      if (!std::exchange(read->cancelled, true))
+        m_io_uring->prepare_cancel(get_read_user_data(*read));
+
+    // wait until the kernel no longer writes to the buffers
+    auto completions = std::move(m_completions);
+    completions.erase(completions.begin(), 
+      completions.begin() + static_cast<std::ptrdiff_t>(m_completion_position));
+    while (!m_pending_reads.empty()) {
+      for (const auto& completion : completions) {
+        const auto it = find_pending_read(completion.user_data);
+        if (it != m_pending_reads.end())
+          m_pending_reads.erase(it);
+      }
+      if (m_pending_reads.empty())
+        break;
+      completions.clear();
+      if (!m_io_uring->submit_and_wait(std::chrono::seconds(1), &completions) ||
+          completions.empty()) {
+        // rather leak than release buffers still in use
+        for (auto& read : m_pending_reads)
+          static_cast<void>(read.release());
+        break;
+      }
+    }
+  }
+#endif // defined(__linux__)
+
+  std::optional<Event> to_event(int event_id, input_event ev) {
+    const auto device = find_grabbed_device(event_id);
+    if (device == m_grabbed_devices.end())
+      return std::nullopt;
+
+    // devices to ungrab are still read, until their keys are released
+    if (ev.type == EV_KEY && ev.value == 0 && !m_deferred_devices.empty())
+      update_deferred_devices();
+
+    const auto device_index = static_cast<int>(
+      std::distance(m_grabbed_devices.begin(), device));
+
+    if (ev.type == EV_ABS) {
+      // map from device range to default range
+      if (ev.code == ABS_VOLUME) {
+        ev.value = map_to_range(ev.value, device->abs_range_volume, default_abs_range);
+      }
+      else if (ev.code == ABS_MISC) {
+        ev.value = map_to_range(ev.value, device->abs_range_misc, default_abs_range);
+      }
+    }
+    else if (ev.type == EV_REL) {
+      if (!device->has_highres_wheel ||
+          !linux_highres_wheel_events) {
+        // convert from low- to highres wheel event (when device does not send these)
+        if (ev.code == REL_WHEEL) {
+          ev.code = REL_WHEEL_HI_RES;
+          ev.value *= 120;
+        }
+        else if (ev.code == REL_HWHEEL) {
+          ev.code = REL_HWHEEL_HI_RES;
+          ev.value *= 120;
+        }
+        else if (ev.code == REL_WHEEL_HI_RES ||
+                 ev.code == REL_HWHEEL_HI_RES) {
+          // ignore highres events when they were not enabled by directive
+          return std::nullopt;
+        }
+      }
+    }
+    
+    const auto time = (device->has_monotonic_time ? 
+      get_event_time(ev) : std::chrono::steady_clock::now());
+    return Event{ device_index, ev.type, ev.code, ev.value, time };
+  }
+
   void initialize_device_monitor() {
     release_device_monitor();
     m_device_monitor_fd = create_event_device_monitor();
+    if (m_device_monitor_fd >= 0)
+      m_device_input_ids_watch = add_device_input_ids_watch(m_device_monitor_fd);
   }
 
   void release_device_monitor() {
     if (m_device_monitor_fd >= 0) {
       ::close(m_device_monitor_fd);
       m_device_monitor_fd = -1;
+      m_device_input_ids_watch = -1;
     }
   }
+
+  void read_device_monitor() {
+#if defined(ENABLE_DEVICE_MONITOR)
+    alignas(inotify_event) char buffer[4096];
+    for (;;) {
+      const auto size = ::read(m_device_monitor_fd, buffer, sizeof(buffer));
+      if (size == -1 && errno == EINTR)
+        continue;
+      if (size <= 0)
+        break;
+
+      for (auto it = buffer; it < buffer + size; ) {
+        const auto& event = *reinterpret_cast<const inotify_event*>(it);
+        it += sizeof(inotify_event) + event.len;
+
+        if (event.mask & IN_Q_OVERFLOW) {
+          // events were lost, fall back to scanning all devices
+          m_rescan_devices = true;
+        }
+        else if (event.wd == m_device_input_ids_watch) {
+          if (event.mask & IN_IGNORED)
+            m_device_input_ids_watch = -1;
+          m_device_input_ids_changed = true;
+        }
+        else if (event.len > 0) {
+          auto event_id = 0;
+          if (::sscanf(event.name, "event%d", &event_id) == 1) {
+            set_device_changed(event_id);
+          }
+          else if ((event.mask & IN_CREATE) && (event.mask & IN_ISDIR) &&
+                   std::strcmp(event.name, "by-id") == 0) {
+            m_device_input_ids_watch =
+              add_device_input_ids_watch(m_device_monitor_fd);
+            m_device_input_ids_changed = true;
+          }
+        }
+      }
+    }
+#endif
+  }
+
+  void set_device_changed(int event_id) {
+    if (std::find(m_changed_event_ids.begin(), m_changed_event_ids.end(),
+          event_id) == m_changed_event_ids.end())
+      m_changed_event_ids.push_back(event_id);
+  }
+
+  void update_device_input_ids() {
+    auto input_ids = get_device_input_ids();
+
+    // reevaluate devices whose input id changed
+    for (const auto& [event_id, input_id] : input_ids) {
+      const auto it = m_device_input_ids.find(event_id);
+      if (it == m_device_input_ids.end() || it->second != input_id)
+        set_device_changed(event_id);
+    }
+    for (const auto& [event_id, input_id] : m_device_input_ids)
+      if (!input_ids.count(event_id))
+        set_device_changed(event_id);
+
+    m_device_input_ids = std::move(input_ids);
+  }
+
+  std::string get_device_input_id(int event_id) const {
+    const auto it = m_device_input_ids.find(event_id);
+    return (it != m_device_input_ids.end() ? it->second : std::string());
+  }
+
+  std::vector<Device>::iterator find_grabbed_device(int event_id) {
+    return std::find_if(m_grabbed_devices.begin(), m_grabbed_devices.end(),
+      [&](const Device& device) { return device.event_id == event_id; });
+  }
   
-  bool grab_device(int event_id, int fd) {
-    wait_until_keys_released(fd);
+  bool grab_device(int event_id, int fd, DeviceDesc desc) {
+    // set before grabbing, so no grabbed event has a realtime timestamp
+    const auto monotonic_clock = set_monotonic_clock(fd);
     if (!grab_event_device(fd, true))
       return false;
 
@@ -480,27 +984,225 @@ private:
       get_device_abs_axis_range(fd, ABS_VOLUME),
       get_device_abs_axis_range(fd, ABS_MISC),
       has_highres_wheel(fd),
+      monotonic_clock,
+      std::move(desc),
     });
     return true;
   }
 
   void ungrab_device(const Device& device) {
-    wait_until_keys_released(device.fd);
+#if defined(__linux__)
+    cancel_read(device.event_id);
+#endif
     grab_event_device(device.fd, false);
     ::close(device.fd);
   }
 
-  void update() {
-    verbose("Updating device list");
+  // only reads state, so devices can be probed concurrently
+  ProbedDevice probe_device(int event_id) const {
+    auto device = ProbedDevice{ };
+    device.event_id = event_id;
+    device.path = "/dev/input/event" + std::to_string(event_id);
+    device.fd = open_event_device(device.path.c_str());
+    if (device.fd < 0) {
+      device.error = errno;
+      return device;
+    }
 
-    // reset device monitor
-    initialize_device_monitor();
+    device.name = get_device_name(device.fd);
+    const auto device_id = get_device_input_id(event_id);
+    device.supported = is_supported_device(device.fd) &&
+      !is_virtual_device(device.name);
+    device.grab = device.supported &&
+      evaluate_grab_filters(m_grab_filters, device.name, device_id,
+        is_grabbed_by_default(device.fd, m_grab_mice));
+    if (device.grab)
+      device.desc = get_device_desc(device.fd, event_id, device.name);
+    return device;
+  }
 
-    // mark all devices as disappeared
-    for (auto& device : m_grabbed_devices)
-      device.disappeared = true;
+  // returns whether the set of grabbed devices changed
+  bool apply_probed_device(ProbedDevice& device) {
+    const auto& path = device.path;
+    const auto it = find_grabbed_device(device.event_id);
+    if (device.fd < 0) {
+      if (it != m_grabbed_devices.end()) {
+        ungrab_device(*it);
+        verbose("  %s ungrabbed", path.c_str());
+        m_grabbed_devices.erase(it);
+        return true;
+      }
+      if (device.error != ENOENT)
+        verbose("  %s opening failed", path.c_str());
+      return false;
+    }
 
-    // grab new devices
+    auto status = (device.supported ? "skipped" : "ignored");
+    auto changed = false;
+    if (device.grab && it == m_grabbed_devices.end()) {
+      status = "grabbing failed";
+      if (grab_device(device.event_id, device.fd, std::move(device.desc))) {
+        status = "grabbed";
+        changed = true;
+      }
+    }
+    else if (device.grab) {
+      status = "already grabbed";
+      if (it->desc.id != device.desc.id) {
+        it->desc.id = device.desc.id;
+        changed = true;
+      }
+    }
+    else if (it != m_grabbed_devices.end()) {
+      status = "ungrabbed";
+      ungrab_device(*it);
+      m_grabbed_devices.erase(it);
+      changed = true;
+    }
+    ::close(device.fd);
+    verbose("  %s %s (%s)", path.c_str(), status, device.name.c_str());
+    return changed;
+  }
+
+  // probes devices concurrently, then applies results in order of event ids
+  bool update_devices(std::vector<int> event_ids, bool wait_until_released) {
+    // probing again replaces a device, which is still deferred
+    for (auto event_id : event_ids)
+      release_deferred_device(event_id);
+
+#if defined(__linux__)
+    // do not delay the output, which was not yet submitted, while probing
+    if (m_io_uring)
+      m_io_uring->submit();
+#endif
+    const auto start_time = Clock::now();
+    std::sort(event_ids.begin(), event_ids.end());
+    auto devices = std::vector<ProbedDevice>(event_ids.size());
+    for_each_parallel(event_ids.size(), [&](size_t index) {
+      devices[index] = probe_device(event_ids[index]);
+    });
+    verbose("  probing %d devices took %.1fms", static_cast<int>(devices.size()),
+      milliseconds_since(start_time));
+
+    // keys need to be released on devices, which are (un)grabbed
+    const auto grabbing_changes = [&](const ProbedDevice& device) {
+      const auto grabbed = 
+        (find_grabbed_device(device.event_id) != m_grabbed_devices.end());
+      return (device.fd >= 0 && device.grab != grabbed);
+    };
+
+    if (wait_until_released) {
+      auto fds = std::vector<int>();
+      for (const auto& device : devices) {
+        if (!grabbing_changes(device))
+          continue;
+        // events of grabbed devices are only received by the grabbing fd
+        const auto it = find_grabbed_device(device.event_id);
+        if (it == m_grabbed_devices.end()) {
+          fds.push_back(device.fd);
+          continue;
+        }
+#if defined(__linux__)
+        // an armed read would compete for the events while waiting
+        cancel_read(device.event_id);
+#endif
+        fds.push_back(it->fd);
+      }
+#if defined(__linux__)
+      if (m_io_uring && !fds.empty())
+        m_io_uring->submit();
+#endif
+      if (!wait_until_keys_released(fds))
+        verbose("  waiting for keys to be released timed out");
+    }
+
+    auto changed = false;
+    for (auto& device : devices) {
+      // do not block while keys are down, (un)grab once they were released
+      if (!wait_until_released && grabbing_changes(device) &&
+          !all_keys_released(device.fd)) {
+        verbose("  %s waiting for keys to be released", device.path.c_str());
+        m_deferred_devices.push_back({ std::move(device), 
+          Clock::now() + key_release_timeout, false, 0 });
+        continue;
+      }
+      changed |= apply_probed_device(device);
+    }
+    return changed;
+  }
+
+  // returns the timeout until the next deadline of a deferred device
+  std::optional<Duration> get_deferred_devices_timeout(
+      std::optional<Duration> timeout) const {
+    const auto now = Clock::now();
+    for (const auto& deferred : m_deferred_devices)
+      if (!deferred.released) {
+        const auto remaining = std::max(Duration::zero(), 
+          std::chrono::duration_cast<Duration>(deferred.deadline - now));
+        if (!timeout || remaining < *timeout)
+          timeout = remaining;
+      }
+    return timeout;
+  }
+
+  void update_deferred_devices() {
+    const auto now = Clock::now();
+    for (auto& deferred : m_deferred_devices)
+      if (!deferred.released && 
+          (now >= deferred.deadline || all_keys_released(deferred.device.fd))) {
+        if (now >= deferred.deadline)
+          verbose("  %s waiting for keys to be released timed out",
+            deferred.device.path.c_str());
+        deferred.released = true;
+        m_deferred_devices_released = true;
+      }
+  }
+
+  // returns whether the set of grabbed devices changed
+  bool apply_released_devices() {
+    if (!std::exchange(m_deferred_devices_released, false))
+      return false;
+
+    auto changed = false;
+    for (auto it = m_deferred_devices.begin(); it != m_deferred_devices.end(); ) {
+      if (!it->released) {
+        ++it;
+        continue;
+      }
+      cancel_release_poll(*it);
+      changed |= apply_probed_device(it->device);
+      it = m_deferred_devices.erase(it);
+    }
+    return changed;
+  }
+
+  void release_deferred_device(int event_id) {
+    const auto it = std::find_if(m_deferred_devices.begin(), 
+      m_deferred_devices.end(), [&](const DeferredDevice& deferred) {
+        return deferred.device.event_id == event_id;
+      });
+    if (it == m_deferred_devices.end())
+      return;
+    cancel_release_poll(*it);
+    ::close(it->device.fd);
+    m_deferred_devices.erase(it);
+  }
+
+  void cancel_release_poll(DeferredDevice& deferred) {
+#if defined(__linux__)
+    if (m_io_uring && deferred.release_poll)
+      m_io_uring->prepare_cancel(std::exchange(deferred.release_poll, 0));
+#endif
+  }
+
+  void rescan_devices() {
+    verbose("Updating device list");
+    const auto start_time = Clock::now();
+
+    m_device_input_ids = get_device_input_ids();
+
+    // update existing device nodes
+    auto event_ids = std::vector<int>();
     auto ec = std::error_code{ };
     for (auto const& entry : std::filesystem::directory_iterator("/dev/input", ec)) {
       const auto& path = entry.path();
@@ -508,40 +1210,14 @@ private:
       if (!entry.is_character_file(ec) || 
           ::sscanf(path.c_str(), "/dev/input/event%d", &event_id) != 1)
         continue;
-
-      if (const auto fd = open_event_device(path.c_str()); fd >= 0) {
-        const auto device_name = get_device_name(fd);
-        const auto device_id = get_device_input_id(event_id);
-        auto status = "ignored";
-        if (is_supported_device(fd) &&
-            !is_virtual_device(device_name)) {
-          status = "skipped";
-          if (evaluate_grab_filters(m_grab_filters, device_name, device_id,
-                is_grabbed_by_default(fd, m_grab_mice))) {
-            const auto it = std::find_if(m_grabbed_devices.begin(), m_grabbed_devices.end(),
-              [&](const Device& device) { return device.event_id == event_id; });
-            if (it == m_grabbed_devices.end()) {
-              status = "grabbing failed";
-              if (grab_device(event_id, fd))
-                status = "grabbed";
-            }
-            else {
-              status = "already grabbed";
-              it->disappeared = false;
-            }
-          }
-        }
-        ::close(fd);
-        verbose("  %s %s (%s)", path.c_str(), status, device_name.c_str());
-      }
-      else {
-        verbose("  %s opening failed", path.c_str());
-      }
+      event_ids.push_back(event_id);
     }
+    update_devices(event_ids, true);
 
     // ungrab disappeared devices
     for (auto it = m_grabbed_devices.begin(); it != m_grabbed_devices.end(); ) {
-      if (it->disappeared) {
+      if (std::find(event_ids.begin(), event_ids.end(), 
+            it->event_id) == event_ids.end()) {
         ungrab_device(*it);
         verbose("  /dev/input/event%d ungrabbed", it->event_id);
         it = m_grabbed_devices.erase(it);
@@ -550,34 +1226,41 @@ private:
         ++it;
       }
     }
+    update_grabbed_device_descs();
+    verbose("Updating device list took %.1fms", milliseconds_since(start_time));
+  }
 
-    // collect grabbed device descs
-    m_grabbed_device_descs.clear();
-    for (const auto& device : m_grabbed_devices) {
-      auto& device_desc = m_grabbed_device_descs.emplace_back(DeviceDesc{
-        get_device_name(device.fd),
-        get_device_input_id(device.event_id),
-      });
+  DeviceDesc get_device_desc(int fd, int event_id, std::string device_name) const {
+    auto device_desc = DeviceDesc{
+      std::move(device_name),
+      get_device_input_id(event_id),
+    };
 
-      // obtain full descs of devices for which to create forward devices
-      if (has_mouse_axes(device.fd) ||
-          has_uncommon_abs_axes(device.fd)) {
-        auto ext = DeviceDescLinux{ };
-        ext.event_id = device.event_id;
-        const auto ids = get_device_ids(device.fd);
-        ext.vendor_id = ids.vendor;
-        ext.product_id = ids.product;
-        ext.version_id = ids.version;
-        ext.keys = get_device_keys(device.fd);
-        ext.rel_axes = get_device_rel_axes(device.fd);
-        ext.abs_axes = get_device_abs_axes(device.fd);
-        ext.rep_events = get_device_rep_events(device.fd);
-        ext.switch_events = get_device_switch_events(device.fd);
-        ext.misc_events = get_device_misc_events(device.fd);
-        ext.properties = get_device_properties(device.fd);
-        device_desc.ext = std::make_shared<DeviceDescLinux>(std::move(ext));
-      }
+    // obtain full descs of devices for which to create forward devices
+    if (has_mouse_axes(fd) ||
+        has_uncommon_abs_axes(fd)) {
+      auto ext = DeviceDescLinux{ };
+      ext.event_id = event_id;
+      const auto ids = get_device_ids(fd);
+      ext.vendor_id = ids.vendor;
+      ext.product_id = ids.product;
+      ext.version_id = ids.version;
+      ext.keys = get_device_keys(fd);
+      ext.rel_axes = get_device_rel_axes(fd);
+      ext.abs_axes = get_device_abs_axes(fd);
+      ext.rep_events = get_device_rep_events(fd);
+      ext.switch_events = get_device_switch_events(fd);
+      ext.misc_events = get_device_misc_events(fd);
+      ext.properties = get_device_properties(fd);
+      device_desc.ext = std::make_shared<DeviceDescLinux>(std::move(ext));
     }
+    return device_desc;
+  }
+
+  void update_grabbed_device_descs() {
+    m_grabbed_device_descs.clear();
+    for (const auto& device : m_grabbed_devices)
+      m_grabbed_device_descs.push_back(device.desc);
   }
 };
 
@@ -599,6 +1282,12 @@ bool GrabbedDevices::update_devices() {
   return m_impl->update_devices();
 }
 
+#if defined(__linux__)
+void GrabbedDevices::set_io_uring(IoUring* io_uring) {
+  m_impl->set_io_uring(io_uring);
+}
+#endif
+
 auto GrabbedDevices::read_input_event(std::optional<Duration> timeout, int interrupt_fd)
     -> std::pair<bool, std::optional<Event>> {
   return m_impl->read_input_event(timeout, interrupt_fd);
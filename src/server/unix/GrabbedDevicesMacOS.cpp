@@ -133,6 +133,12 @@ public:
     m_grab_mice = grab_mice;
     m_grab_filters = std::move(grab_filters);
 
+    // when already initialized, only the difference is applied
+    if (m_hid_manager) {
+      update();
+      return true;
+    }
+
     m_hid_manager = IOHIDManagerCreate(kCFAllocatorDefault, kIOHIDOptionsTypeNone);
     if (!m_hid_manager)
       return false;
@@ -243,7 +249,8 @@ private:
         code = *Key::IntlBackslash;
     }
 
-    m_event_queue.push_back({ static_cast<int>(device_index), page, code, value });
+    m_event_queue.push_back({ static_cast<int>(device_index), page, code, value,
+      std::chrono::steady_clock::now() });
   }
 
   void update() {
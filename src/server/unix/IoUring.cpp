@@ -0,0 +1,303 @@
+
+#include "IoUring.h"
+
+#if defined(__linux__)
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+#include <ctime>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+  const auto ring_entries = 256u;
+  const auto write_user_data = uint64_t{ 0 };
+  const auto cancel_user_data = uint64_t{ 1 };
+
+  int io_uring_setup(unsigned int entries, io_uring_params* params) {
+    return static_cast<int>(::syscall(__NR_io_uring_setup, entries, params));
+  }
+
+  int io_uring_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+      unsigned int flags, const void* arg, size_t arg_size) {
+    return static_cast<int>(::syscall(__NR_io_uring_enter, fd, to_submit,
+      min_complete, flags, arg, arg_size));
+  }
+
+  unsigned int load_acquire(const unsigned int* value) {
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+  }
+
+  void store_release(unsigned int* value, unsigned int new_value) {
+    __atomic_store_n(value, new_value, __ATOMIC_RELEASE);
+  }
+
+  template<typename T>
+  T* offset(void* base, unsigned int offset) {
+    return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+  }
+
+  void* map_ring(int fd, size_t size, off_t offset) {
+    const auto ring = ::mmap(nullptr, size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, fd, offset);
+    return (ring != MAP_FAILED ? ring : nullptr);
+  }
+} // namespace
+
+IoUring::~IoUring() {
+  if (m_fd < 0)
+    return;
+  wait_writes();
+  release();
+}
+
+void IoUring::release() {
+  if (m_sqes)
+    ::munmap(std::exchange(m_sqes, nullptr), m_sqes_size);
+  if (m_cq_ring && m_cq_ring != m_sq_ring)
+    ::munmap(m_cq_ring, m_cq_ring_size);
+  m_cq_ring = nullptr;
+  if (m_sq_ring)
+    ::munmap(std::exchange(m_sq_ring, nullptr), m_sq_ring_size);
+  if (m_fd >= 0)
+    ::close(std::exchange(m_fd, -1));
+}
+
+bool IoUring::initialize() {
+  if (m_fd >= 0)
+    return true;
+
+  auto params = io_uring_params{ };
+  const auto fd = io_uring_setup(ring_entries, &params);
+  if (fd < 0)
+    return false;
+  m_fd = fd;
+
+  // timeouts are passed to io_uring_enter (Linux 5.11)
+  if (!(params.features & IORING_FEAT_EXT_ARG)) {
+    release();
+    return false;
+  }
+
+  m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  if (params.features & IORING_FEAT_SINGLE_MMAP)
+    m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+  m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+  m_sq_ring = map_ring(m_fd, m_sq_ring_size, IORING_OFF_SQ_RING);
+  m_cq_ring = (params.features & IORING_FEAT_SINGLE_MMAP ? m_sq_ring :
+    map_ring(m_fd, m_cq_ring_size, IORING_OFF_CQ_RING));
+  m_sqes = static_cast<io_uring_sqe*>(
+    map_ring(m_fd, m_sqes_size, IORING_OFF_SQES));
+  if (!m_sq_ring || !m_cq_ring || !m_sqes) {
+    release();
+    return false;
+  }
+
+  m_sq_head = offset<unsigned int>(m_sq_ring, params.sq_off.head);
+  m_sq_tail = offset<unsigned int>(m_sq_ring, params.sq_off.tail);
+  m_sq_mask = *offset<unsigned int>(m_sq_ring, params.sq_off.ring_mask);
+  m_sq_entries = params.sq_entries;
+  m_cq_head = offset<unsigned int>(m_cq_ring, params.cq_off.head);
+  m_cq_tail = offset<unsigned int>(m_cq_ring, params.cq_off.tail);
+  m_cq_mask = *offset<unsigned int>(m_cq_ring, params.cq_off.ring_mask);
+  m_cqes = offset<io_uring_cqe>(m_cq_ring, params.cq_off.cqes);
+
+  // submission queue entries are always used in order
+  const auto array = offset<unsigned int>(m_sq_ring, params.sq_off.array);
+  for (auto i = 0u; i < m_sq_entries; ++i)
+    array[i] = i;
+  return true;
+}
+
+io_uring_sqe* IoUring::get_sqe() {
+  const auto tail = *m_sq_tail;
+  if (tail - load_acquire(m_sq_head) >= m_sq_entries) {
+    // submit to make room
+    if (!submit() || tail - load_acquire(m_sq_head) >= m_sq_entries)
+      return nullptr;
+  }
+  auto sqe = &m_sqes[tail & m_sq_mask];
+  std::memset(sqe, 0, sizeof(io_uring_sqe));
+  return sqe;
+}
+
+bool IoUring::prepare_read(int fd, void* buffer, size_t size,
+    uint64_t user_data) {
+  const auto sqe = get_sqe();
+  if (!sqe)
+    return false;
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(buffer);
+  sqe->len = static_cast<uint32_t>(size);
+  sqe->off = static_cast<uint64_t>(-1);
+  sqe->user_data = user_data;
+  m_last_write = nullptr;
+  store_release(m_sq_tail, *m_sq_tail + 1);
+  return true;
+}
+
+bool IoUring::prepare_poll(int fd, uint64_t user_data) {
+  const auto sqe = get_sqe();
+  if (!sqe)
+    return false;
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = fd;
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  sqe->poll32_events = (POLLIN << 16);
+#else
+  sqe->poll32_events = POLLIN;
+#endif
+  sqe->user_data = user_data;
+  m_last_write = nullptr;
+  store_release(m_sq_tail, *m_sq_tail + 1);
+  return true;
+}
+
+bool IoUring::prepare_cancel(uint64_t user_data) {
+  const auto sqe = get_sqe();
+  if (!sqe)
+    return false;
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  sqe->fd = -1;
+  sqe->addr = user_data;
+  sqe->user_data = cancel_user_data;
+  m_last_write = nullptr;
+  store_release(m_sq_tail, *m_sq_tail + 1);
+  return true;
+}
+
+bool IoUring::prepare_write(int fd, const void* data, size_t size) {
+  const auto sqe = get_sqe();
+  if (!sqe)
+    return false;
+
+  if (m_write_buffers_used == m_write_buffers.size())
+    m_write_buffers.emplace_back();
+  auto& buffer = m_write_buffers[m_write_buffers_used++];
+  buffer.assign(static_cast<const char*>(data),
+    static_cast<const char*>(data) + size);
+
+  sqe->opcode = IORING_OP_WRITE;
+  sqe->fd = fd;
+  sqe->addr = reinterpret_cast<uint64_t>(buffer.data());
+  sqe->len = static_cast<uint32_t>(size);
+  sqe->off = static_cast<uint64_t>(-1);
+  sqe->user_data = write_user_data;
+  if (m_last_write)
+    m_last_write->flags |= IOSQE_IO_LINK;
+  m_last_write = sqe;
+  ++m_writes_pending;
+  store_release(m_sq_tail, *m_sq_tail + 1);
+  return true;
+}
+
+bool IoUring::enter(unsigned int min_complete,
+    std::optional<Duration> timeout) {
+  auto ts = __kernel_timespec{ };
+  auto arg = io_uring_getevents_arg{ };
+  if (timeout) {
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::max(*timeout, Duration::zero())).count();
+    ts.tv_sec = ns / 1000000000;
+    ts.tv_nsec = ns % 1000000000;
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+  }
+
+  for (;;) {
+    // link chains end with a submission
+    m_last_write = nullptr;
+    const auto to_submit = *m_sq_tail - load_acquire(m_sq_head);
+    if (!to_submit && !min_complete)
+      return true;
+    const auto flags = (min_complete ?
+      IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG : 0u);
+    const auto result = io_uring_enter(m_fd, to_submit, min_complete,
+      flags, (min_complete ? &arg : nullptr), (min_complete ? sizeof(arg) : 0));
+    if (result >= 0 || errno == ETIME)
+      return true;
+    if (errno == EINTR)
+      continue;
+    // completion queue is full, let caller read it
+    return (errno == EBUSY || errno == EAGAIN);
+  }
+}
+
+void IoUring::read_completions() {
+  auto head = *m_cq_head;
+  const auto tail = load_acquire(m_cq_tail);
+  for (; head != tail; ++head) {
+    const auto& cqe = m_cqes[head & m_cq_mask];
+    if (cqe.user_data == write_user_data) {
+      if (cqe.res < 0)
+        m_writes_failed = true;
+      if (--m_writes_pending == 0) {
+        m_write_buffers_used = 0;
+        m_writes_completed_at = Clock::now();
+      }
+    }
+    else if (cqe.user_data != cancel_user_data) {
+      m_completions.push_back({ cqe.user_data, cqe.res });
+    }
+  }
+  store_release(m_cq_head, head);
+}
+
+bool IoUring::submit_and_wait(std::optional<Duration> timeout,
+    std::vector<Completion>* completions) {
+  const auto timeout_at = (timeout ?
+    std::make_optional(Clock::now() + *timeout) : std::nullopt);
+  read_completions();
+  for (;;) {
+    const auto remaining = (timeout_at ?
+      std::make_optional(Duration(*timeout_at - Clock::now())) : std::nullopt);
+    const auto wait = (m_completions.empty() &&
+      (!remaining || *remaining > Duration::zero()));
+    if (!enter(wait ? 1 : 0, remaining))
+      return false;
+    read_completions();
+
+    // continue waiting when only writes completed
+    if (!wait || !m_completions.empty() ||
+        (timeout_at && Clock::now() >= *timeout_at))
+      break;
+  }
+  completions->insert(completions->end(),
+    m_completions.begin(), m_completions.end());
+  m_completions.clear();
+  return true;
+}
+
+bool IoUring::submit() {
+  if (!enter(0, std::nullopt))
+    return false;
+  read_completions();
+  return true;
+}
+
+bool IoUring::wait_writes() {
+  read_completions();
+  while (m_writes_pending) {
+    if (!enter(1, std::nullopt))
+      return false;
+    read_completions();
+  }
+  return true;
+}
+
+bool IoUring::writes_failed() {
+  return std::exchange(m_writes_failed, false);
+}
+
+std::optional<Clock::time_point> IoUring::writes_completed() {
+  return std::exchange(m_writes_completed_at, std::nullopt);
+}
+
+#endif // defined(__linux__)
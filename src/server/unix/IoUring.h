@@ -0,0 +1,79 @@
+#pragma once
+
+#include "common/Duration.h"
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// a minimal io_uring, set up with raw syscalls so no library is needed.
+// reads and polls are completed to the caller, writes are submitted in
+// order along with the next wait and their results are tracked internally.
+class IoUring {
+public:
+  // user data values below are reserved
+  static constexpr uint64_t first_user_data = 2;
+
+  struct Completion {
+    uint64_t user_data;
+    int result;
+  };
+
+  IoUring() = default;
+  IoUring(const IoUring&) = delete;
+  IoUring& operator=(const IoUring&) = delete;
+  ~IoUring();
+
+  bool initialize();
+  bool initialized() const { return (m_fd >= 0); }
+
+  bool prepare_read(int fd, void* buffer, size_t size, uint64_t user_data);
+  bool prepare_poll(int fd, uint64_t user_data);
+  bool prepare_cancel(uint64_t user_data);
+  // data is copied, consecutive writes are linked to keep their order
+  bool prepare_write(int fd, const void* data, size_t size);
+
+  // submits prepared requests and waits for completions until timeout
+  bool submit_and_wait(std::optional<Duration> timeout,
+    std::vector<Completion>* completions);
+  bool submit();
+  // submits and waits until all writes completed
+  bool wait_writes();
+  // returns whether a write failed since the last call
+  bool writes_failed();
+  bool writes_pending() const { return (m_writes_pending != 0); }
+  // returns when all pending writes completed since the last call
+  std::optional<Clock::time_point> writes_completed();
+
+private:
+  void release();
+  struct io_uring_sqe* get_sqe();
+  bool enter(unsigned int min_complete, std::optional<Duration> timeout);
+  void read_completions();
+
+  int m_fd{ -1 };
+  void* m_sq_ring{ };
+  size_t m_sq_ring_size{ };
+  void* m_cq_ring{ };
+  size_t m_cq_ring_size{ };
+  struct io_uring_sqe* m_sqes{ };
+  size_t m_sqes_size{ };
+  unsigned int* m_sq_head{ };
+  unsigned int* m_sq_tail{ };
+  unsigned int m_sq_mask{ };
+  unsigned int m_sq_entries{ };
+  unsigned int* m_cq_head{ };
+  unsigned int* m_cq_tail{ };
+  unsigned int m_cq_mask{ };
+  struct io_uring_cqe* m_cqes{ };
+  // the last prepared write, which is linked to the next write
+  struct io_uring_sqe* m_last_write{ };
+  // kept until all writes completed
+  std::vector<std::vector<char>> m_write_buffers;
+  size_t m_write_buffers_used{ };
+  size_t m_writes_pending{ };
+  bool m_writes_failed{ };
+  std::optional<Clock::time_point> m_writes_completed_at;
+  // read but not yet returned to the caller
+  std::vector<Completion> m_completions;
+};
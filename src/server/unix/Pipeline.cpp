@@ -0,0 +1,291 @@
+
+#include "Pipeline.h"
+#include "SpscQueue.h"
+#include "Wakeup.h"
+#include "VirtualDevices.h"
+#include "server/Statistics.h"
+#include "common/output.h"
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <poll.h>
+
+namespace {
+  const auto queue_capacity = size_t{ 1024 };
+
+  // returns whether fd became readable
+  bool wait_readable(int fd, int other_fd, std::optional<Duration> timeout) {
+    pollfd fds[2] = { { fd, POLLIN, 0 }, { other_fd, POLLIN, 0 } };
+    const auto count = (other_fd >= 0 ? 2 : 1);
+    const auto timeout_ms = (timeout ? static_cast<int>(
+      std::max(timeout->count(), 0.0) * 1000.0 + 0.999) : -1);
+    const auto result = ::poll(fds, count, timeout_ms);
+    return (result > 0 && (fds[0].revents & POLLIN));
+  }
+
+  struct Output {
+    enum class Type : uint8_t { key, forward, flush };
+    Type type;
+    KeyEvent key_event;
+    GrabbedDevices::Event event;
+    std::optional<Clock::time_point> input_time;
+  };
+} // namespace
+
+//-------------------------------------------------------------------------
+
+class PipelineImpl {
+private:
+  using Event = GrabbedDevices::Event;
+
+  GrabbedDevices* m_grabbed_devices{ };
+  VirtualDevices* m_virtual_devices{ };
+  Statistics* m_statistics{ };
+  std::thread m_reader;
+  std::thread m_writer;
+  std::atomic<bool> m_stopping{ };
+  std::atomic<bool> m_reader_finished{ };
+  std::atomic<bool> m_reading_failed{ };
+  std::atomic<bool> m_devices_updated{ };
+  std::atomic<bool> m_writing_failed{ };
+  Wakeup m_stop_wakeup;
+  Wakeup m_input_wakeup;
+  Wakeup m_output_wakeup;
+  // signaled when a full queue was popped from, so pushing can block
+  // instead of spinning, which could starve the consumer on a shared CPU
+  Wakeup m_input_space_wakeup;
+  Wakeup m_output_space_wakeup;
+  SpscQueue<Event, queue_capacity> m_input_queue;
+  SpscQueue<Output, queue_capacity> m_output_queue;
+
+public:
+  ~PipelineImpl() {
+    stop();
+  }
+
+  bool start(GrabbedDevices& grabbed_devices, VirtualDevices& virtual_devices,
+      Statistics& statistics) {
+    if (running())
+      return true;
+    if (!m_stop_wakeup.valid() ||
+        !m_input_wakeup.valid() ||
+        !m_output_wakeup.valid() ||
+        !m_input_space_wakeup.valid() ||
+        !m_output_space_wakeup.valid())
+      return false;
+
+    m_grabbed_devices = &grabbed_devices;
+    m_virtual_devices = &virtual_devices;
+    m_statistics = &statistics;
+    m_reader_finished.store(false);
+    m_reading_failed.store(false);
+    m_devices_updated.store(false);
+    m_writing_failed.store(false);
+    m_reader = std::thread(&PipelineImpl::read_input, this);
+    m_writer = std::thread(&PipelineImpl::write_output, this);
+    return true;
+  }
+
+  void stop() {
+    if (!running())
+      return;
+
+    m_stopping.store(true);
+    m_stop_wakeup.signal();
+    m_output_wakeup.signal();
+    m_reader.join();
+    m_writer.join();
+    m_stop_wakeup.reset();
+    m_stopping.store(false);
+  }
+
+  bool running() const {
+    return m_writer.joinable();
+  }
+
+  std::pair<bool, std::optional<Event>> read_input_event(
+      std::optional<Duration> timeout, int interrupt_fd) {
+    const auto timeout_at = (timeout ?
+      std::make_optional(Clock::now() + *timeout) : std::nullopt);
+    for (;;) {
+      if (auto event = pop_input())
+        return { true, event };
+
+      m_input_wakeup.reset();
+      if (auto event = pop_input())
+        return { true, event };
+
+      if (m_reader_finished.load())
+        return { !m_reading_failed.load(), std::nullopt };
+
+      const auto remaining = (timeout_at ?
+        std::make_optional(Duration(*timeout_at - Clock::now())) : std::nullopt);
+      if (!wait_readable(m_input_wakeup.fd(), interrupt_fd, remaining))
+        return { true, std::nullopt };
+    }
+  }
+
+  // only once all events read before the update were processed,
+  // since the device indices were changed by the update
+  bool devices_updated() const {
+    return (m_devices_updated.load() && m_input_queue.empty());
+  }
+
+  std::optional<Event> take_queued_input() {
+    return m_input_queue.pop();
+  }
+
+  // returns false when writing previous output failed
+  bool push_output(const Output& output) {
+    while (!m_output_queue.push(output)) {
+      // reset before retrying, so no signal is missed
+      m_output_space_wakeup.reset();
+      if (m_output_queue.push(output))
+        break;
+      m_output_wakeup.signal();
+      wait_readable(m_output_space_wakeup.fd(), -1, std::nullopt);
+    }
+    m_output_wakeup.signal();
+    return !m_writing_failed.load();
+  }
+
+private:
+  std::optional<Event> pop_input() {
+    auto event = m_input_queue.pop();
+    if (event)
+      m_input_space_wakeup.signal();
+    return event;
+  }
+
+  // returns false when stopping while queue is full
+  bool push_input(const Event& event) {
+    while (!m_input_queue.push(event)) {
+      m_input_space_wakeup.reset();
+      if (m_input_queue.push(event))
+        break;
+      if (m_stopping.load())
+        return false;
+      wait_readable(m_input_space_wakeup.fd(), m_stop_wakeup.fd(), std::nullopt);
+    }
+    m_input_wakeup.signal();
+    return true;
+  }
+
+  void read_input() {
+    for (;;) {
+      const auto [succeeded, input] =
+        m_grabbed_devices->read_input_event(std::nullopt, m_stop_wakeup.fd());
+      if (!succeeded) {
+        m_reading_failed.store(true);
+        break;
+      }
+
+      if (input) {
+        if (!push_input(*input))
+          return;
+      }
+      else if (m_stopping.load()) {
+        return;
+      }
+      else if (m_grabbed_devices->update_devices()) {
+        // let processing thread update virtual devices, before continuing
+        m_devices_updated.store(true);
+        break;
+      }
+    }
+    m_reader_finished.store(true);
+    m_input_wakeup.signal();
+  }
+
+  void write_output() {
+    for (;;) {
+      m_output_wakeup.reset();
+      const auto stopping = m_stopping.load();
+      while (auto output = m_output_queue.pop()) {
+        m_output_space_wakeup.signal();
+        if (!apply_output(*output))
+          m_writing_failed.store(true);
+      }
+      if (stopping)
+        break;
+      wait_readable(m_output_wakeup.fd(), -1, std::nullopt);
+    }
+  }
+
+  bool apply_output(const Output& output) {
+    switch (output.type) {
+      case Output::Type::key:
+        return m_virtual_devices->send_key_event(output.key_event);
+
+      case Output::Type::forward: {
+        // like in single-threaded mode, failing to forward is not fatal
+        const auto& event = output.event;
+        m_virtual_devices->forward_event(event.device_index,
+          event.type, event.code, event.value);
+        return true;
+      }
+
+      case Output::Type::flush:
+        if (!m_virtual_devices->flush())
+          return false;
+        if (output.input_time)
+          m_statistics->add(Statistics::Latency::output,
+            Clock::now() - *output.input_time);
+        return true;
+    }
+    return false;
+  }
+};
+
+//-------------------------------------------------------------------------
+
+Pipeline::Pipeline() = default;
+Pipeline::Pipeline(Pipeline&&) noexcept = default;
+Pipeline& Pipeline::operator=(Pipeline&&) noexcept = default;
+Pipeline::~Pipeline() = default;
+
+bool Pipeline::start(GrabbedDevices& grabbed_devices, VirtualDevices& virtual_devices,
+    Statistics& statistics) {
+  if (!m_impl)
+    m_impl = std::make_unique<PipelineImpl>();
+  if (!m_impl->start(grabbed_devices, virtual_devices, statistics))
+    return false;
+  verbose("Reading and writing devices in separate threads");
+  return true;
+}
+
+void Pipeline::stop() {
+  if (m_impl)
+    m_impl->stop();
+}
+
+bool Pipeline::running() const {
+  return (m_impl && m_impl->running());
+}
+
+auto Pipeline::read_input_event(std::optional<Duration> timeout, int interrupt_fd)
+    -> std::pair<bool, std::optional<Event>> {
+  return m_impl->read_input_event(timeout, interrupt_fd);
+}
+
+bool Pipeline::devices_updated() const {
+  return (m_impl && m_impl->devices_updated());
+}
+
+auto Pipeline::take_queued_input() -> std::optional<Event> {
+  if (!m_impl || m_impl->running())
+    return std::nullopt;
+  return m_impl->take_queued_input();
+}
+
+bool Pipeline::send_key_event(const KeyEvent& event) {
+  return m_impl->push_output({ Output::Type::key, event, { }, { } });
+}
+
+bool Pipeline::forward_event(const Event& event) {
+  return m_impl->push_output({ Output::Type::forward, { }, event, { } });
+}
+
+bool Pipeline::flush(std::optional<Clock::time_point> input_time) {
+  return m_impl->push_output({ Output::Type::flush, { }, { }, input_time });
+}
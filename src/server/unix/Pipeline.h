@@ -0,0 +1,41 @@
+#pragma once
+
+#include "GrabbedDevices.h"
+#include "common/Duration.h"
+#include <memory>
+#include <optional>
+#include <utility>
+
+class VirtualDevices;
+class Statistics;
+
+// reads input and writes output in separate threads, so that
+// device updates and writes do not delay the processing of input
+class Pipeline {
+public:
+  using Event = GrabbedDevices::Event;
+
+  Pipeline();
+  Pipeline(Pipeline&&) noexcept;
+  Pipeline& operator=(Pipeline&&) noexcept;
+  ~Pipeline();
+
+  // devices must not be accessed by caller while pipeline is running
+  bool start(GrabbedDevices& grabbed_devices, VirtualDevices& virtual_devices,
+    Statistics& statistics);
+  void stop();
+  bool running() const;
+
+  std::pair<bool, std::optional<Event>> read_input_event(
+    std::optional<Duration> timeout, int interrupt_fd);
+  bool devices_updated() const;
+  // input which was read but not yet processed when pipeline was stopped
+  std::optional<Event> take_queued_input();
+
+  bool send_key_event(const KeyEvent& event);
+  bool forward_event(const Event& event);
+  bool flush(std::optional<Clock::time_point> input_time);
+
+private:
+  std::unique_ptr<class PipelineImpl> m_impl;
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+
+// lock-free queue for exactly one producer and one consumer thread
+template<typename T, size_t Capacity>
+class SpscQueue {
+  static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+
+public:
+  bool push(const T& value) {
+    const auto tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_head.load(std::memory_order_acquire) == Capacity)
+      return false;
+    m_items[tail & (Capacity - 1)] = value;
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // only reliable in the consumer thread
+  bool empty() const {
+    return (m_head.load(std::memory_order_relaxed) == 
+      m_tail.load(std::memory_order_acquire));
+  }
+
+  std::optional<T> pop() {
+    const auto head = m_head.load(std::memory_order_relaxed);
+    if (head == m_tail.load(std::memory_order_acquire))
+      return std::nullopt;
+    auto value = m_items[head & (Capacity - 1)];
+    m_head.store(head + 1, std::memory_order_release);
+    return value;
+  }
+
+private:
+  // keep on separate cache lines, to prevent false sharing
+  alignas(64) std::atomic<size_t> m_head{ };
+  alignas(64) std::atomic<size_t> m_tail{ };
+  alignas(64) std::array<T, Capacity> m_items{ };
+};
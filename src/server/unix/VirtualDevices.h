@@ -18,6 +18,10 @@ public:
   ~VirtualDevices();
 
   bool create_keyboard_device();
+#if defined(__linux__)
+  // writes using io_uring, set after creating the keyboard device
+  void set_io_uring(class IoUring* io_uring);
+#endif
   bool update_forward_devices(const std::vector<DeviceDesc>& device_descs);
   bool send_key_event(const KeyEvent& event);
   bool forward_event(int device_index, int type, int code, int value);
@@ -8,13 +8,15 @@
 #include <cerrno>
 #include <fcntl.h>
 #include <unistd.h>
+#include <array>
 #include <chrono>
-#include <map>
+#include <utility>
 
 #if defined(__FreeBSD__)
 # include <dev/evdev/uinput.h>
 #else
 # include <linux/uinput.h>
+# include "IoUring.h"
 #endif
 
 namespace {
@@ -171,12 +173,18 @@ namespace {
 
   class VirtualDevice {
   private:
-    const int m_uinput_fd{ -1 };
-    const bool m_has_mouse_axes{ false };
+    int m_uinput_fd{ -1 };
+#if defined(__linux__)
+    IoUring* m_io_uring{ };
+#endif
+    bool m_has_mouse_axes{ false };
     std::vector<Key> m_down_keys;
-    int m_highres_wheel_accumulators[2]{ };
+    std::array<int, 2> m_highres_wheel_accumulators{ };
+    std::vector<input_event> m_events;
 
   public:
+    VirtualDevice() = default;
+
     explicit VirtualDevice(int uinput_fd)
       : m_uinput_fd(uinput_fd) {
     }
@@ -186,14 +194,43 @@ namespace {
         m_has_mouse_axes(::has_mouse_axes(desc)) {
     }
 
+    VirtualDevice(VirtualDevice&& rhs) noexcept {
+      *this = std::move(rhs);
+    }
+
+    VirtualDevice& operator=(VirtualDevice&& rhs) noexcept {
+      if (this != &rhs) {
+        release();
+        m_uinput_fd = std::exchange(rhs.m_uinput_fd, -1);
+#if defined(__linux__)
+        m_io_uring = rhs.m_io_uring;
+#endif
+        m_has_mouse_axes = rhs.m_has_mouse_axes;
+        m_down_keys = std::move(rhs.m_down_keys);
+        m_highres_wheel_accumulators = rhs.m_highres_wheel_accumulators;
+        m_events = std::move(rhs.m_events);
+      }
+      return *this;
+    }
+
     ~VirtualDevice() {
-      destroy_uinput_device(m_uinput_fd);
+      release();
+    }
+
+    bool created() const {
+      return (m_uinput_fd >= 0);
     }
 
     bool has_mouse_axes() const {
       return m_has_mouse_axes;
     }
 
+#if defined(__linux__)
+    void set_io_uring(IoUring* io_uring) {
+      m_io_uring = io_uring;
+    }
+#endif
+
     int update_key_state(const KeyEvent& event) {
       const auto release = 0;
       const auto press = 1;
@@ -232,92 +269,227 @@ namespace {
       event.type = static_cast<unsigned short>(type);
       event.code = static_cast<unsigned short>(code);
       event.value = value;
+      m_events.push_back(event);
+      return true;
+    }
+
+    // write all events with a single call
+    bool flush() {
+      if (m_events.empty())
+        return true;
+      const auto size = m_events.size() * sizeof(input_event);
+#if defined(__linux__)
+      if (m_io_uring) {
+        // submitted along with the next wait for input
+        const auto succeeded = m_io_uring->prepare_write(
+          m_uinput_fd, m_events.data(), size);
+        m_events.clear();
+        return succeeded;
+      }
+#endif
+      auto result = ssize_t{ };
       do {
-        const auto result = ::write(m_uinput_fd, &event, sizeof(event));
-        if (result >= 0)
-          return (result == sizeof(event));
-      } while (errno == EINTR);
+        result = ::write(m_uinput_fd, m_events.data(), size);
+      } while (result == -1 && errno == EINTR);
 
-      return false;
+      m_events.clear();
+      return (result == static_cast<ssize_t>(size));
+    }
+
+  private:
+    void release() {
+      flush();
+      destroy_uinput_device(std::exchange(m_uinput_fd, -1));
     }
   };
+
+  int get_event_id(const DeviceDesc& desc) {
+    const auto desc_ext = static_cast<const DeviceDescLinux*>(desc.ext.get());
+    return (desc_ext ? desc_ext->event_id : -1);
+  }
 } // namespace
 
 //-------------------------------------------------------------------------
 
 class VirtualDevicesImpl {
 private:
-  std::unique_ptr<VirtualDevice> m_keyboard;
-  std::map<int, VirtualDevice> m_forward_devices;
-  std::vector<VirtualDevice*> m_devices;
-  VirtualDevice* m_last_active_mouse{ };
+  struct ForwardDevice {
+    DeviceDesc desc;
+    // created on first forwarded event, until then virtual keyboard is used
+    bool create_pending;
+    VirtualDevice device;
+  };
+
+  VirtualDevice m_keyboard;
+  // indexed by device index
+  std::vector<ForwardDevice> m_forward_devices;
+  int m_last_active_mouse{ -1 };
+  VirtualDevice* m_device_with_events{ };
+#if defined(__linux__)
+  IoUring* m_io_uring{ };
+#endif
+
+  // devices must not be destroyed while writes are pending
+  void wait_writes() {
+#if defined(__linux__)
+    if (m_io_uring)
+      m_io_uring->wait_writes();
+#endif
+  }
+
+  // events are written in batches, flush when the device changes to keep order
+  bool set_device_with_events(VirtualDevice* device) {
+    auto succeeded = true;
+    if (m_device_with_events && m_device_with_events != device)
+      succeeded = m_device_with_events->flush();
+    m_device_with_events = device;
+    return succeeded;
+  }
+
+  bool create_forward_device(ForwardDevice& forward_device) {
+    forward_device.create_pending = false;
+    const auto& desc = forward_device.desc;
+    const auto& desc_ext = static_cast<const DeviceDescLinux&>(*desc.ext);
+    const auto uinput_fd = ::create_forward_device(
+      get_forward_device_name(desc.name), desc_ext);
+    if (uinput_fd < 0)
+      return false;
+    forward_device.device = VirtualDevice(uinput_fd, desc_ext);
+#if defined(__linux__)
+    forward_device.device.set_io_uring(m_io_uring);
+#endif
+    return true;
+  }
+
+  VirtualDevice& get_device(int device_index) {
+    auto& device = m_forward_devices[device_index].device;
+    return (device.created() ? device : m_keyboard);
+  }
 
 public:
+  ~VirtualDevicesImpl() {
+    flush();
+    wait_writes();
+  }
+
+#if defined(__linux__)
+  void set_io_uring(IoUring* io_uring) {
+    flush();
+    wait_writes();
+    m_io_uring = io_uring;
+    m_keyboard.set_io_uring(io_uring);
+    for (auto& forward_device : m_forward_devices)
+      forward_device.device.set_io_uring(io_uring);
+  }
+#endif
+
   bool create_keyboard_device() {
     const auto uinput_fd = ::create_keyboard_device();
     if (uinput_fd < 0)
       return false;
-    m_keyboard = std::make_unique<VirtualDevice>(uinput_fd);
+    m_keyboard = VirtualDevice(uinput_fd);
     return true;
   }
 
   bool update_forward_devices(const std::vector<DeviceDesc>& device_descs) {
+    flush();
+    wait_writes();
     auto prev = std::move(m_forward_devices);
-    m_last_active_mouse = nullptr;
+    m_last_active_mouse = -1;
     m_forward_devices.clear();
-    m_devices.clear();
+    m_forward_devices.reserve(device_descs.size());
     for (const auto& desc : device_descs) {
       // by default forward events using virtual keyboard
-      auto& device = m_devices.emplace_back(m_keyboard.get());
-      
-      // create virtual forward device for event id (reuse existing)      
-      if (const auto* desc_ext = static_cast<const DeviceDescLinux*>(desc.ext.get())) {
-        if (auto node = prev.extract(desc_ext->event_id)) {
-          device = &m_forward_devices.insert(std::move(node)).position->second;
-        }
-        else {
-          const auto uinput_fd = ::create_forward_device(
-            get_forward_device_name(desc.name), *desc_ext);
-          if (uinput_fd < 0)
-             return false;
-          device = &m_forward_devices.emplace(std::piecewise_construct,
-            std::forward_as_tuple(desc_ext->event_id), 
-            std::forward_as_tuple(uinput_fd, *desc_ext)).first->second;
-        }
+      auto& forward_device = m_forward_devices.emplace_back(
+        ForwardDevice{ desc, false, VirtualDevice() });
+      const auto event_id = get_event_id(desc);
+      if (event_id < 0)
+        continue;
+
+      // reuse existing virtual forward device of event id
+      const auto it = std::find_if(prev.begin(), prev.end(),
+        [&](const ForwardDevice& device) {
+          return (device.device.created() && get_event_id(device.desc) == event_id);
+        });
+      if (it != prev.end()) {
+        forward_device.device = std::move(it->device);
+      }
+      else if (has_mouse_axes(static_cast<const DeviceDescLinux&>(*desc.ext))) {
+        // create mice in advance, they also output mouse buttons
+        if (!create_forward_device(forward_device))
+          return false;
+      }
+      else {
+        forward_device.create_pending = true;
       }
     }
     return true;
   }
 
   bool forward_event(int device_index, int type, int code, int value) {
-    auto device = m_devices[device_index];
+    if (device_index < 0 || 
+        device_index >= static_cast<int>(m_forward_devices.size()))
+      return false;
+
+    auto& forward_device = m_forward_devices[device_index];
+    if (forward_device.create_pending) {
+      // these are only forwarded along with other events
+      if (type == EV_SYN || type == EV_MSC)
+        return true;
+
+      if (!create_forward_device(forward_device)) {
+        error("Creating virtual forward device failed");
+        return false;
+      }
+    }
+
+    auto& device = get_device(device_index);
+    if (device.has_mouse_axes())
+      m_last_active_mouse = device_index;
 
-    if (device->has_mouse_axes())
-      m_last_active_mouse = device;
+    if (!set_device_with_events(&device) ||
+        !device.send_event(type, code, value))
+      return false;
 
-    return device->send_event(type, code, value);
+    // write whole frames
+    if (type == EV_SYN)
+      return flush();
+    return true;
   }
 
-  bool send_key_event(const KeyEvent& event) {
-    auto device = m_keyboard.get();
+  bool flush() {
+    if (!set_device_with_events(nullptr))
+      return false;
+#if defined(__linux__)
+    // report failures of previous writes
+    if (m_io_uring && m_io_uring->writes_failed())
+      return false;
+#endif
+    return true;
+  }
 
+  bool send_key_event(const KeyEvent& event) {
     // send mouse buttons and wheel events with last active mouse
-    if (m_last_active_mouse && (is_mouse_button(event.key) || is_mouse_wheel(event.key)))
-      device = m_last_active_mouse;
+    auto& device = (m_last_active_mouse >= 0 &&
+      (is_mouse_button(event.key) || is_mouse_wheel(event.key)) ?
+        get_device(m_last_active_mouse) : m_keyboard);
+
+    if (!set_device_with_events(&device))
+      return false;
 
     if (is_mouse_wheel(event.key)) {
       const auto vertical = (event.key == Key::WheelUp || event.key == Key::WheelDown);
       const auto negative = (event.key == Key::WheelDown || event.key == Key::WheelLeft);
       const auto value = (event.value ? event.value : 120) * (negative ? -1 : 1);
-      device->send_event(EV_REL, (vertical ? REL_WHEEL_HI_RES : REL_HWHEEL_HI_RES), value);
-      if (auto lowres_value = device->update_lowres_wheel(vertical, value))
-        device->send_event(EV_REL, (vertical ? REL_WHEEL : REL_HWHEEL), lowres_value);
+      device.send_event(EV_REL, (vertical ? REL_WHEEL_HI_RES : REL_HWHEEL_HI_RES), value);
+      if (auto lowres_value = device.update_lowres_wheel(vertical, value))
+        device.send_event(EV_REL, (vertical ? REL_WHEEL : REL_HWHEEL), lowres_value);
     }
     else {
-      if (!device->send_event(EV_KEY, *event.key, device->update_key_state(event)))
+      if (!device.send_event(EV_KEY, *event.key, device.update_key_state(event)))
         return false;
     }
-    return device->send_event(EV_SYN, SYN_REPORT, 0);
+    return device.send_event(EV_SYN, SYN_REPORT, 0);
   }
 };
 
@@ -337,6 +509,13 @@ bool VirtualDevices::create_keyboard_device() {
   return true;
 }
 
+#if defined(__linux__)
+void VirtualDevices::set_io_uring(IoUring* io_uring) {
+  if (m_impl)
+    m_impl->set_io_uring(io_uring);
+}
+#endif
+
 bool VirtualDevices::update_forward_devices(const std::vector<DeviceDesc>& device_descs) {
   return (m_impl && m_impl->update_forward_devices(device_descs));
 }
@@ -350,5 +529,5 @@ bool VirtualDevices::forward_event(int device_index, int type, int code, int val
 }
 
 bool VirtualDevices::flush() {
-  return true;
+  return (m_impl && m_impl->flush());
 }
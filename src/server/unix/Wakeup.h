@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+
+// a pipe written to wake up a thread, which is waiting for it
+class Wakeup {
+private:
+  int m_fds[2]{ -1, -1 };
+  std::atomic<bool> m_signaled{ };
+
+public:
+  Wakeup() {
+    if (::pipe(m_fds) == 0)
+      for (auto fd : m_fds) {
+        ::fcntl(fd, F_SETFL, O_NONBLOCK);
+        ::fcntl(fd, F_SETFD, FD_CLOEXEC);
+      }
+  }
+  Wakeup(const Wakeup&) = delete;
+  Wakeup& operator=(const Wakeup&) = delete;
+
+  ~Wakeup() {
+    for (auto fd : m_fds)
+      if (fd >= 0)
+        ::close(fd);
+  }
+
+  bool valid() const {
+    return (m_fds[0] >= 0);
+  }
+
+  int fd() const {
+    return m_fds[0];
+  }
+
+  // only writes when not already signaled, to save system calls
+  void signal() {
+    if (!m_signaled.exchange(true)) {
+      const auto byte = char{ };
+      while (::write(m_fds[1], &byte, 1) == -1 && errno == EINTR);
+    }
+  }
+
+  // reset before checking for work, so no signal is missed
+  void reset() {
+    m_signaled.store(false);
+    char buffer[64];
+    while (::read(m_fds[0], buffer, sizeof(buffer)) > 0);
+  }
+};
@@ -0,0 +1,74 @@
+
+#if defined(__linux__)
+
+#include "enable_realtime.h"
+#include "common/output.h"
+#include <cerrno>
+#include <cstring>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+namespace {
+  const auto realtime_priority = 50;
+  const auto fallback_nice_level = -20;
+  const auto prefault_stack_size = 256 * 1024;
+
+  void set_scheduling() {
+    // threads started later inherit the scheduling policy
+    auto param = sched_param{ };
+    param.sched_priority = realtime_priority;
+    if (::sched_setscheduler(0, SCHED_FIFO, &param) == 0) {
+      verbose("Realtime: SCHED_FIFO scheduling with priority %d enabled",
+        realtime_priority);
+      return;
+    }
+    verbose("Realtime: enabling SCHED_FIFO scheduling failed (%s)",
+      std::strerror(errno));
+
+    if (::setpriority(PRIO_PROCESS, 0, fallback_nice_level) == 0)
+      verbose("Realtime: nice level set to %d", fallback_nice_level);
+    else
+      verbose("Realtime: setting nice level failed (%s)", std::strerror(errno));
+  }
+
+  void pin_to_cpu(int cpu) {
+    auto cpu_set = cpu_set_t{ };
+    CPU_ZERO(&cpu_set);
+    CPU_SET(cpu, &cpu_set);
+    if (::sched_setaffinity(0, sizeof(cpu_set), &cpu_set) == 0)
+      verbose("Realtime: pinned to CPU %d", cpu);
+    else
+      verbose("Realtime: pinning to CPU %d failed (%s)", cpu, std::strerror(errno));
+  }
+
+  void lock_memory() {
+    // only lock pages once they are touched, otherwise the whole
+    // stack of every thread started later would be populated
+    auto flags = MCL_CURRENT | MCL_FUTURE;
+#if defined(MCL_ONFAULT)
+    flags |= MCL_ONFAULT;
+#endif
+    if (::mlockall(flags) == 0)
+      verbose("Realtime: memory locked");
+    else
+      verbose("Realtime: locking memory failed (%s)", std::strerror(errno));
+  }
+
+  [[gnu::noinline]] void prefault_stack() {
+    [[maybe_unused]] volatile char stack[prefault_stack_size];
+    for (auto i = 0; i < prefault_stack_size; i += 4096)
+      stack[i] = 0;
+  }
+} // namespace
+
+void enable_realtime(std::optional<int> cpu) {
+  set_scheduling();
+  if (cpu)
+    pin_to_cpu(*cpu);
+  lock_memory();
+  prefault_stack();
+  verbose("Realtime: prefaulted %d KB of stack", prefault_stack_size / 1024);
+}
+
+#endif // __linux__
@@ -0,0 +1,5 @@
+#pragma once
+
+#include <optional>
+
+void enable_realtime(std::optional<int> cpu);
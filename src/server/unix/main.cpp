@@ -1,64 +1,98 @@
 
 #include "GrabbedDevices.h"
 #include "VirtualDevices.h"
+#include "Pipeline.h"
+#include "IoUring.h"
+#include "enable_realtime.h"
 #include "server/Settings.h"
 #include "server/ServerState.h"
 #include "runtime/Timeout.h"
 #include "common/output.h"
 #include <csignal>
 #include <atomic>
+#include <poll.h>
 
 namespace {
   class ServerStateImpl final : public ServerState {
   private:
     bool on_send_key(const KeyEvent& event) override;
+    bool on_flushed_send_buffer() override;
     void on_exit_requested() override;
-    void on_configuration_message(MultiStagePtr stage) override;
     void on_grab_device_filters_message(
       std::vector<GrabDeviceFilter> filters) override;
     void on_directives_message(
       const std::vector<std::string>& directives) override;
   };
   
+#if defined(__linux__)
+  // destroyed after the devices, which use it
+  IoUring g_io_uring;
+#endif
   VirtualDevices g_virtual_devices;
   GrabbedDevices g_grabbed_devices;
+  Pipeline g_pipeline;
+  bool g_pipelined;
+  std::optional<Clock::time_point> g_input_time;
+  // input times of output, which is written with the next io_uring wait
+  std::vector<Clock::time_point> g_pending_output_times;
   int g_interrupt_fd;
+  int g_listen_fd{ -1 };
   std::atomic<bool> g_shutdown;
   std::vector<GrabDeviceFilter> m_grab_device_filters;
-  bool g_grab_device_filters_changed;
+  bool g_devices_grabbed;
+  bool g_grabbed_mice;
+  std::vector<GrabDeviceFilter> g_grabbed_device_filters;
   ServerStateImpl g_state;
+
+  // devices are kept grabbed for a while, so a reconnecting client goes unnoticed
+  const auto reconnect_timeout = std::chrono::seconds(1);
+  const auto realtime_buffer_reserve = size_t{ 1024 };
   
   bool ServerStateImpl::on_send_key(const KeyEvent& event) {
+    if (g_pipeline.running())
+      return g_pipeline.send_key_event(event);
     return g_virtual_devices.send_key_event(event);
   }
 
-  void ServerStateImpl::on_exit_requested() {
-    g_shutdown.store(true);
+  bool ServerStateImpl::on_flushed_send_buffer() {
+    const auto input_time = std::exchange(g_input_time, std::nullopt);
+    if (g_pipeline.running())
+      return g_pipeline.flush(input_time);
+    const auto succeeded = g_virtual_devices.flush();
+    if (!input_time)
+      return succeeded;
+#if defined(__linux__)
+    // record latency once the writes completed
+    if (g_io_uring.writes_pending()) {
+      if (g_pending_output_times.empty())
+        g_io_uring.writes_completed();
+      g_pending_output_times.push_back(*input_time);
+      return succeeded;
+    }
+#endif
+    statistics().add(Statistics::Latency::output, Clock::now() - *input_time);
+    return succeeded;
   }
 
-  void ServerStateImpl::on_configuration_message(MultiStagePtr stage) {
-    if (has_configuration() &&
-        has_mouse_mappings() != stage->has_mouse_mappings()) {
-      verbose("Mouse usage in configuration changed");
-      g_grab_device_filters_changed = true;
+  void add_pending_output_latencies() {
+#if defined(__linux__)
+    if (g_pending_output_times.empty())
+      return;
+    if (const auto completed_at = g_io_uring.writes_completed()) {
+      for (const auto& input_time : g_pending_output_times)
+        g_state.statistics().add(Statistics::Latency::output,
+          *completed_at - input_time);
+      g_pending_output_times.clear();
     }
-    ServerState::on_configuration_message(std::move(stage));
+#endif
+  }
+
+  void ServerStateImpl::on_exit_requested() {
+    g_shutdown.store(true);
   }
-    
+
   void ServerStateImpl::on_grab_device_filters_message(
       std::vector<GrabDeviceFilter> filters) {
-    const auto filters_changed =
-      !std::equal(m_grab_device_filters.begin(),
-        m_grab_device_filters.end(), filters.begin(), filters.end(),
-        [](const GrabDeviceFilter& a, const GrabDeviceFilter& b) {
-          return (std::tie(a.string, a.invert, a.by_id) ==
-                  std::tie(b.string, b.invert, b.by_id));
-        });
-
-    if (has_configuration() && filters_changed) {
-      verbose("Grab device filters changed");
-      g_grab_device_filters_changed = true;
-    }
     m_grab_device_filters = std::move(filters);
   }
   
@@ -81,6 +115,177 @@ namespace {
     ServerState::on_directives_message(directives);
   }
 
+  bool equal_filters(const std::vector<GrabDeviceFilter>& a,
+      const std::vector<GrabDeviceFilter>& b) {
+    return std::equal(a.begin(), a.end(), b.begin(), b.end(),
+      [](const GrabDeviceFilter& a, const GrabDeviceFilter& b) {
+        return (std::tie(a.string, a.invert, a.by_id) ==
+                std::tie(b.string, b.invert, b.by_id));
+      });
+  }
+
+  bool is_readable(int fd) {
+    auto pfd = pollfd{ fd, POLLIN, 0 };
+    return (::poll(&pfd, 1, 0) == 1);
+  }
+
+  bool update_forward_devices() {
+    if (!g_virtual_devices.update_forward_devices(
+          g_grabbed_devices.grabbed_device_descs()))
+      return false;
+    g_state.set_device_descs(g_grabbed_devices.grabbed_device_descs());
+    return true;
+  }
+
+  // processes the input, which was read before the pipeline was stopped,
+  // while the device indices are still valid and before newer input
+  void stop_pipeline() {
+    g_pipeline.stop();
+    auto processed = false;
+    while (const auto input = g_pipeline.take_queued_input()) {
+      if (auto event = to_key_event(*input)) {
+        if (event->key != Key::none)
+          g_state.translate_input(*event, input->device_index, input->time);
+      }
+      else {
+        g_virtual_devices.forward_event(input->device_index,
+          input->type, input->code, input->value);
+      }
+      processed = true;
+    }
+    if (processed)
+      g_state.flush_send_buffer();
+  }
+
+  // only applies what changed since devices were grabbed by previous client
+  bool grab_devices() {
+    const auto grab_mice = g_state.has_mouse_mappings();
+    if (g_devices_grabbed) {
+      const auto mice_changed = (grab_mice != g_grabbed_mice);
+      const auto filters_changed =
+        !equal_filters(m_grab_device_filters, g_grabbed_device_filters);
+      if (!mice_changed && !filters_changed)
+        return true;
+      if (mice_changed)
+        verbose("Mouse usage in configuration changed");
+      if (filters_changed)
+        verbose("Grab device filters changed");
+    }
+
+    // devices must not be accessed while pipeline is running
+    stop_pipeline();
+
+    const auto start_time = Clock::now();
+    if (!g_devices_grabbed &&
+        !g_virtual_devices.create_keyboard_device()) {
+      error("Creating virtual keyboard failed");
+      return false;
+    }
+#if defined(__linux__)
+    if (g_io_uring.initialized()) {
+      g_grabbed_devices.set_io_uring(&g_io_uring);
+      // the pipeline writes in another thread
+      if (!g_pipelined)
+        g_virtual_devices.set_io_uring(&g_io_uring);
+    }
+#endif
+    if (!g_grabbed_devices.grab(grab_mice, m_grab_device_filters)) {
+      error("Initializing input device grabbing failed");
+      return false;
+    }
+    g_devices_grabbed = true;
+    g_grabbed_mice = grab_mice;
+    g_grabbed_device_filters = m_grab_device_filters;
+
+    if (!update_forward_devices()) {
+      error("Creating virtual forward devices failed");
+      return false;
+    }
+    verbose("Initializing devices took %.1fms", milliseconds_since(start_time));
+    return true;
+  }
+
+  bool start_pipeline() {
+    if (!g_pipelined)
+      return true;
+    if (!g_pipeline.start(g_grabbed_devices, g_virtual_devices,
+          g_state.statistics())) {
+      error("Starting pipeline failed");
+      return false;
+    }
+    return true;
+  }
+
+  // returns false when updating virtual devices failed
+  bool update_devices() {
+    if (g_pipeline.running()) {
+      if (!g_pipeline.devices_updated())
+        return true;
+      // grabbed devices were updated by reader thread, which then finished
+      stop_pipeline();
+      return (update_forward_devices() && start_pipeline());
+    }
+    return (!g_grabbed_devices.update_devices() || update_forward_devices());
+  }
+
+  std::pair<bool, std::optional<GrabbedDevices::Event>> read_input_event(
+      std::optional<Duration> timeout) {
+    if (g_pipeline.running())
+      return g_pipeline.read_input_event(timeout, g_interrupt_fd);
+    return g_grabbed_devices.read_input_event(timeout, g_interrupt_fd);
+  }
+
+  bool forward_event(const GrabbedDevices::Event& event) {
+    if (g_pipeline.running())
+      return g_pipeline.forward_event(event);
+    return g_virtual_devices.forward_event(event.device_index,
+      event.type, event.code, event.value);
+  }
+
+  void release_devices() {
+    if (!std::exchange(g_devices_grabbed, false))
+      return;
+    g_grabbed_devices = { };
+    g_virtual_devices = { };
+    add_pending_output_latencies();
+  }
+
+  // forwards input unmapped until a client connects or timeout elapsed
+  bool wait_for_reconnect() {
+    verbose("Waiting for keymapper to reconnect");
+    const auto timeout_at = Clock::now() + reconnect_timeout;
+    for (;;) {
+      const auto now = Clock::now();
+      if (g_shutdown.load() || now >= timeout_at)
+        return false;
+
+      const auto [succeeded, input] =
+        g_grabbed_devices.read_input_event(timeout_at - now, g_listen_fd);
+      if (!succeeded)
+        return false;
+
+      if (input) {
+        if (auto event = to_key_event(input.value())) {
+          if (event->key != Key::none)
+            g_state.translate_input(event.value(), input->device_index, input->time);
+          g_state.flush_send_buffer();
+        }
+        else {
+          g_virtual_devices.forward_event(input->device_index,
+            input->type, input->code, input->value);
+        }
+        continue;
+      }
+
+      if (g_grabbed_devices.update_devices() &&
+          !update_forward_devices())
+        return false;
+
+      if (is_readable(g_listen_fd))
+        return true;
+    }
+  }
+
   bool read_initial_config() {
     while (!g_state.has_configuration()) {
       if (!g_state.read_client_messages()) {
@@ -113,24 +318,32 @@ namespace {
       }
 
       // interrupt waiting when client sends an update
-      const auto [succeeded, input] =
-        g_grabbed_devices.read_input_event(timeout, g_interrupt_fd);
+      const auto [succeeded, input] = read_input_event(timeout);
       if (!succeeded) {
         error("Reading input event failed");
         return true;
       }
+      add_pending_output_latencies();
 
       now = Clock::now();
 
       if (input) {
+        s.statistics().add(Statistics::Latency::read, now - input->time);
         if (auto event = to_key_event(input.value())) {
-          if (event->key != Key::none)
-            s.translate_input(event.value(), input->device_index);
+          if (event->key != Key::none) {
+            // apply the contexts, which were sent since the last event
+            if (g_interrupt_fd >= 0 && is_readable(g_interrupt_fd) &&
+                !s.read_client_messages(Duration::zero())) {
+              verbose("Connection to keymapper reset");
+              return true;
+            }
+            g_input_time = input->time;
+            s.translate_input(event.value(), input->device_index, input->time);
+          }
         }
         else {
           // forward other events
-          g_virtual_devices.forward_event(input->device_index,
-            input->type, input->code, input->value);
+          forward_event(input.value());
           continue;
         }
       }
@@ -138,6 +351,7 @@ namespace {
       if (s.timeout_start_at() &&
           now >= s.timeout_start_at().value() + s.timeout()) {
         const auto timeout = make_input_timeout_event(s.timeout());
+        s.statistics().increment(Statistics::Counter::timeouts_fired);
         s.cancel_timeout();
         s.translate_input(timeout, Stage::any_device_index);
       }
@@ -149,23 +363,21 @@ namespace {
         }
       }
 
-      if (g_grabbed_devices.update_devices()) {
-        if (!g_virtual_devices.update_forward_devices(
-            g_grabbed_devices.grabbed_device_descs())) {
-          verbose("Updating virtual forward devices failed");
-          return true;
-        }
-        s.set_device_descs(g_grabbed_devices.grabbed_device_descs());
+      if (!update_devices()) {
+        verbose("Updating virtual forward devices failed");
+        return true;
       }
 
       // let client update configuration and context
-      if (g_interrupt_fd >= 0)
+      if (g_interrupt_fd >= 0) {
         if (!s.read_client_messages(Duration::zero()) ||
-            std::exchange(g_grab_device_filters_changed, false) ||
             !s.has_configuration()) {
           verbose("Connection to keymapper reset");
           return true;
         }
+        if (!grab_devices() || !start_pipeline())
+          return false;
+      }
 
       if (s.should_exit())
         return false;
@@ -179,6 +391,9 @@ namespace {
  
   int connection_loop() {
     while (!g_shutdown.load()) {
+      if (g_devices_grabbed && !wait_for_reconnect())
+        release_devices();
+
       verbose("Waiting for keymapper to connect");
       const auto client_socket = g_state.accept_client_connection();
 
@@ -186,28 +401,16 @@ namespace {
         error("Client version mismatch detected");
         return 1;
       }
-      if (!client_socket)
+      if (!client_socket) {
+        release_devices();
         continue;
+      }
 
       g_interrupt_fd = *client_socket;
 
       if (read_initial_config()) {
-        if (!g_virtual_devices.create_keyboard_device()) {
-          error("Creating virtual keyboard failed");
-          return 1;
-        }
-
-        if (!g_grabbed_devices.grab(g_state.has_mouse_mappings(),
-              m_grab_device_filters)) {
-          error("Initializing input device grabbing failed");
-          return 1;
-        }
-        if (!g_virtual_devices.update_forward_devices(
-              g_grabbed_devices.grabbed_device_descs())) {
-          error("Creating virtual forward devices failed");
+        if (!grab_devices() || !start_pipeline())
           return 1;
-        }
-        g_state.set_device_descs(g_grabbed_devices.grabbed_device_descs());
 
         const auto prev_sigint_handler = ::signal(SIGINT, handle_shutdown_signal);
         const auto prev_sigterm_handler = ::signal(SIGTERM, handle_shutdown_signal);
@@ -215,16 +418,16 @@ namespace {
         verbose("Entering update loop");
         if (!main_loop())
           g_shutdown.store(true);
+        stop_pipeline();
         g_state.reset_configuration();
 
         ::signal(SIGINT, prev_sigint_handler);
         ::signal(SIGTERM, prev_sigterm_handler);
       }
-      g_grabbed_devices = { };
-      g_virtual_devices = { };
       g_state.disconnect();
       verbose("---------------");
     }
+    release_devices();
     return 0;
   }
 } // namespace
@@ -237,6 +440,31 @@ int main(int argc, char* argv[]) {
     return 1;
   }
   g_verbose_output = settings.verbose;
+  g_pipelined = settings.pipelined;
+
+#if defined(__linux__)
+  if (settings.io_uring) {
+    if (g_io_uring.initialize())
+      verbose("Reading and writing devices using io_uring");
+    else
+      error("Initializing io_uring failed, using select");
+  }
+
+  if (settings.realtime) {
+    g_state.set_buffer_reserve(realtime_buffer_reserve);
+    enable_realtime(settings.realtime_cpu);
+  }
+#endif
+
+  if (!settings.record_filename.empty()) {
+    auto recording = std::make_unique<RecordingWriter>();
+    if (!recording->open(settings.record_filename)) {
+      error("Opening recording file '%s' failed", settings.record_filename.c_str());
+      return 1;
+    }
+    verbose("Recording input to '%s'", settings.record_filename.c_str());
+    g_state.set_recording(std::move(recording));
+  }
 
 #if defined(__APPLE__)
   // when running as user in the graphical environment try to grab input device and exit.
@@ -245,8 +473,10 @@ int main(int argc, char* argv[]) {
     return (g_grabbed_devices.grab(false, { }) ? 0 : 1);
 #endif
 
-  if (!g_state.listen_for_client_connections())
+  const auto listen_socket = g_state.listen_for_client_connections();
+  if (!listen_socket)
     return 1;
+  g_listen_fd = *listen_socket;
 
   return connection_loop();
 }
@@ -533,6 +533,7 @@ namespace {
         }
         else if (wparam == TIMER_TIMEOUT) {
           const auto timeout = make_input_timeout_event(g_state.timeout());
+          g_state.statistics().increment(Statistics::Counter::timeouts_fired);
           g_state.cancel_timeout();
           g_state.translate_input(timeout, Stage::any_device_index);
           if (!g_state.flush_scheduled_at())
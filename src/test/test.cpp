@@ -6,6 +6,7 @@
 #include "config/ParseKeySequence.h"
 #include "config/ParseConfig.h"
 #include "runtime/Key.h"
+#include "runtime/create_multi_stage.h"
 #include "runtime/Timeout.h"
 
 namespace {
@@ -155,31 +156,10 @@ std::pair<MultiStagePtr, DirectivesList> create_multi_stage(const char* string)
   auto stream = std::stringstream(string);
   auto config = parse_config(stream);
 
-  auto stages = std::vector<StagePtr>();
-  auto contexts = std::vector<Stage::Context>();
-  for (auto& config_context : config.contexts) {
-    if (!contexts.empty() && config_context.begin_stage) {
-      stages.push_back(std::make_unique<Stage>(std::move(contexts)));
-      contexts.clear();
-    }
-  
-    auto& context = contexts.emplace_back();
-    for (auto& input : config_context.inputs)
-      context.inputs.push_back({ std::move(input.input), input.output_index });
-    context.outputs = std::move(config_context.outputs);
-    for (auto& output : config_context.command_outputs)
-      context.command_outputs.push_back({ std::move(output.output), output.index });
-    context.device_filter = std::move(config_context.device_filter);
-    context.device_id_filter = std::move(config_context.device_id_filter);
-    context.modifier_filter = std::move(config_context.modifier_filter);
-    context.fallthrough = config_context.fallthrough;
-  }
-  if (!contexts.empty()) {
-    auto& stage = stages.emplace_back(std::make_unique<Stage>(std::move(contexts)));
-    stage->set_history_timing(std::chrono::milliseconds(50));
-  }
-
-  return { std::make_unique<MultiStage>(std::move(stages)), config.server_directives };
+  auto multi_stage = ::create_multi_stage(config);
+  if (!multi_stage->stages().empty())
+    multi_stage->stages().back()->set_history_timing(std::chrono::milliseconds(50));
+  return { std::move(multi_stage), config.server_directives };
 }
 
 KeyEvent reply_timeout_ms(int timeout_ms) {
@@ -1,6 +1,7 @@
 
 #include "test.h"
 #include "config/ParseConfig.h"
+#include "config/ContextMatcher.h"
 
 namespace {
   Config parse_config(const char* config) {
@@ -630,6 +631,68 @@ TEST_CASE("Context filters", "[ParseConfig]") {
 
 //--------------------------------------------------------------------
 
+TEST_CASE("Context matcher", "[ParseConfig]") {
+  auto string = R"(
+    A >> command
+
+    [class = "Class1"]
+    command >> B
+
+    [class = "Class1" title = /Title1|Title2/]
+    command >> C
+
+    [class = /Class\d/ title = "Title3"]
+    command >> D
+
+    [title = "Title3"]
+    command >> E
+
+    [class = "Class2" title != "Title1"]
+    command >> F
+
+    [class != "Class1" path = "Path"]
+    command >> G
+
+    [class = "Class1"]
+    command >> H
+  )";
+
+  auto config = parse_config(string);
+  REQUIRE(config.contexts.size() == 8);
+
+  const auto match_contexts = [&](const std::string& window_class,
+      const std::string& window_title, const std::string& window_path) {
+    auto indices = std::vector<int>();
+    for (auto i = 0; i < static_cast<int>(config.contexts.size()); ++i)
+      if (config.contexts[i].matches(window_class, window_title, window_path))
+        indices.push_back(i);
+    return indices;
+  };
+
+  auto matcher = ContextMatcher();
+  matcher.set_contexts(config.contexts);
+  const auto classes = { "", "Class1", "Class2", "Class3", "Other" };
+  const auto titles = { "", "Title1", "_Title2_", "Title3", "Other" };
+  const auto paths = { "", "Path", "/bin/Path" };
+  for (auto repeat = 0; repeat < 2; ++repeat)
+    for (auto window_class : classes)
+      for (auto window_title : titles)
+        for (auto window_path : paths)
+          CHECK(matcher.match(window_class, window_title, window_path) ==
+                match_contexts(window_class, window_title, window_path));
+
+  CHECK(matcher.match("Class1", "Title1", "") == 
+    std::vector<int>{ 0, 1, 2, 7 });
+  CHECK(matcher.match("Class2", "Title3", "Path") == 
+    std::vector<int>{ 0, 3, 4, 5, 6 });
+
+  // cached results are discarded
+  matcher.set_contexts({ config.contexts[0] });
+  CHECK(matcher.match("Class1", "Title1", "") == std::vector<int>{ 0 });
+}
+
+//--------------------------------------------------------------------
+
 TEST_CASE("Context filters #2", "[ParseConfig]") {
   auto string = R"(
     A >> command
@@ -1641,3 +1704,27 @@ TEST_CASE("Automatically generated Virtual", "[ParseConfig]") {
   CHECK(format_sequence(config.contexts[0].inputs[9].input) == "+ShiftRight +A ~A ~ShiftRight");
   CHECK(format_sequence(config.contexts[0].outputs[9]) == "+ShiftRight +Virtual256 -Virtual256 -ShiftRight");
 }
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Line numbers of contexts and mappings", "[ParseConfig]") {
+  auto string = R"(
+    A >> B
+
+    [title="Test"]
+    C >> D
+    E >> command
+    command >> F
+  )";
+
+  auto config = parse_config(string);
+  REQUIRE(config.contexts.size() == 2);
+  CHECK(config.contexts[0].line_no == 0);
+  REQUIRE(config.contexts[0].inputs.size() == 1);
+  CHECK(config.contexts[0].inputs[0].line_no == 2);
+
+  CHECK(config.contexts[1].line_no == 4);
+  REQUIRE(config.contexts[1].inputs.size() == 2);
+  CHECK(config.contexts[1].inputs[0].line_no == 5);
+  CHECK(config.contexts[1].inputs[1].line_no == 6);
+}
@@ -3637,3 +3637,67 @@ TEST_CASE("String typing input #5", "[Stage]") {
 }
 
 //--------------------------------------------------------------------
+
+TEST_CASE("Profile matching of mappings", "[Stage]") {
+  auto config = R"(
+    A >> B
+    C >> D
+  )";
+  Stage stage = create_stage(config);
+  CHECK(stage.profile().empty());
+
+  stage.set_profiling(true);
+  REQUIRE(stage.profile().size() == stage.contexts().size());
+  CHECK(apply_input(stage, "+C -C") == "+D -D");
+  CHECK(apply_input(stage, "+C -C") == "+D -D");
+
+  const auto& profile = stage.profile()[0];
+  REQUIRE(profile.size() == 2);
+  CHECK(profile[0].calls > 0);
+  CHECK(profile[0].matches == 0);
+  CHECK(profile[1].calls > 0);
+  CHECK(profile[1].matches == 2);
+
+  stage.set_profiling(false);
+  CHECK(stage.profile().empty());
+  REQUIRE(stage.is_clear());
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Trace stage updates", "[Stage]") {
+  auto config = R"(
+    A >> B
+    C >> D
+  )";
+  Stage stage = create_stage(config);
+  auto trace = TraceBuffer(4);
+  stage.set_trace(&trace, 1);
+
+  CHECK(apply_input(stage, "+C -C") == "+D -D");
+  CHECK(apply_input(stage, "+X") == "+X");
+  auto records = trace.records();
+  REQUIRE(records.size() == 3);
+  CHECK(records[0].type == TraceRecord::Type::stage_update);
+  CHECK(records[0].event == KeyEvent(Key::C, KeyState::Down));
+  CHECK(records[0].stage_index == 1);
+  CHECK(records[0].context_index == 0);
+  CHECK(records[0].input_index == 1);
+  CHECK(records[0].output_count == 1);
+  CHECK(records[2].context_index == -1);
+  CHECK(records[2].input_index == -1);
+
+  // only the most recent records are kept
+  CHECK(apply_input(stage, "-X +A -A") == "-X +B -B");
+  records = trace.records();
+  REQUIRE(records.size() == 4);
+  CHECK(records[0].event == KeyEvent(Key::X, KeyState::Down));
+  CHECK(records[3].event == KeyEvent(Key::A, KeyState::Up));
+
+  stage.set_trace(nullptr, 0);
+  CHECK(apply_input(stage, "+A -A") == "+B -B");
+  CHECK(trace.records().size() == 4);
+  REQUIRE(stage.is_clear());
+}
+
+//--------------------------------------------------------------------
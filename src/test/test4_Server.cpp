@@ -2,24 +2,30 @@
 #include "test.h"
 #include "runtime/Timeout.h"
 #include "server/ServerState.h"
+#include "server/ClientPortStub.h"
+#include "client/ServerPort.h"
+#include "config/ParseConfig.h"
+#include <filesystem>
+#include <thread>
 #include <utility>
 
+#if !defined(_WIN32)
+# include <fcntl.h>
+# include <sys/socket.h>
+# include <unistd.h>
+#endif
+#if defined(__linux__)
+# include <sys/mman.h>
+#endif
+
 namespace {
-  class ClientPortImpl : public IClientPort {
+  class ClientPortImpl : public ClientPortStub {
   private:
     std::vector<std::function<void(MessageHandler&)>> m_client_messages;
     std::vector<int> m_triggered_actions;
 
   public:
-    Socket socket() const override { return 0; }
-    Socket listen_socket() const override { return 0; }
-    bool version_mismatch() const override { return false; }
-    bool listen() override { return false; }
-    bool accept() override { return false; }
-    void disconnect() override { }
     bool send_triggered_action(int action) override { m_triggered_actions.push_back(action); return true; }
-    bool send_virtual_key_state(Key key, KeyState state) override { return true; }
-    bool send_next_key_info(const std::vector<Key>& keys, const DeviceDesc& device_desc) override { return true; }
 
     bool read_messages(MessageHandler& handler, 
         std::optional<Duration> timeout) override {
@@ -84,9 +90,10 @@ namespace {
       return result;
     }
 
-    std::string apply_input(const KeySequence& sequence, int device_index = 0) {
+    std::string apply_input(const KeySequence& sequence, int device_index = 0,
+        Clock::time_point time = Clock::now()) {
       for (auto event : sequence)
-        if (!translate_input(event, device_index))
+        if (!translate_input(event, device_index, time))
           m_output.push_back(event);
 
       if (!flush_scheduled_at())
@@ -110,6 +117,11 @@ namespace {
       return apply_input(parse_sequence(input), device_index);
     }
 
+    template<size_t N>
+    std::string apply_input(const char(&input)[N], Clock::time_point time) {
+      return apply_input(parse_sequence(input), 0, time);
+    }
+
     std::string apply_timeout(Duration timeout) {
       auto event = make_input_timeout_event(timeout);
       cancel_timeout();
@@ -625,6 +637,87 @@ TEST_CASE("Multi staging - ContextActive", "[Server]") {
 
 //--------------------------------------------------------------------
 
+TEST_CASE("Multi staging - skip stages with unchanged contexts", "[Server]") {
+  const auto config = R"(
+    [title="App1"]    # 0
+    ContextActive >> X ^ Y
+    [title="App2"]    # 1
+    A >> B
+
+    [stage]           # 2
+    X >> Z
+    [title="App1"]    # 3
+    ContextActive >> C ^ D
+
+    [stage]           # 4
+    [title="App3"]    # 5
+    ContextActive >> E ^ F
+    Z >> G
+  )";
+  auto [multi_stage, directives] = create_multi_stage(config);
+  auto [reference, reference_directives] = create_multi_stage(config);
+  REQUIRE(multi_stage->stages().size() == 3);
+
+  // like MultiStage, but always updating every stage
+  const auto set_contexts_in_all_stages = [&](const std::vector<int>& indices) {
+    auto output = KeySequence();
+    auto context_offset = 0;
+    for (const auto& stage : reference->stages()) {
+      const auto input = std::exchange(output, { });
+      for (const auto& event : input)
+        if (event.key == Key::timeout || is_virtual_key(event.key) ||
+            is_action_key(event.key)) {
+          output.push_back(event);
+        }
+        else {
+          const auto stage_output = stage->update(event, Stage::no_device_index);
+          output.insert(output.end(), stage_output.begin(), stage_output.end());
+        }
+
+      const auto context_count = static_cast<int>(stage->contexts().size());
+      auto stage_indices = std::vector<int>();
+      for (auto index : indices)
+        if (index >= context_offset && index < context_offset + context_count)
+          stage_indices.push_back(index - context_offset);
+      context_offset += context_count;
+
+      const auto stage_output = stage->set_active_client_contexts(stage_indices);
+      output.insert(output.end(), stage_output.begin(), stage_output.end());
+    }
+    return output;
+  };
+
+  const auto apply_input = [](MultiStage& stage, const char* input) {
+    auto output = KeySequence();
+    for (const auto& event : parse_sequence(input, input + std::strlen(input))) {
+      auto event_output = stage.update(event, 0);
+      output.insert(output.end(), event_output.begin(), event_output.end());
+      stage.reuse_buffer(std::move(event_output));
+    }
+    return format_sequence(output);
+  };
+
+  // enumerate subsets of the contexts in an order, which also repeats some
+  const auto context_count = 6;
+  for (auto i = 0; i < 3 * (1 << context_count); ++i) {
+    const auto mask = (i * 37 / 3) % (1 << context_count);
+    auto indices = std::vector<int>();
+    for (auto index = 0; index < context_count; ++index)
+      if (mask & (1 << index))
+        indices.push_back(index);
+
+    auto output = multi_stage->set_active_client_contexts(indices);
+    const auto expected = set_contexts_in_all_stages(indices);
+    INFO("mask " << mask);
+    CHECK(format_sequence(output) == format_sequence(expected));
+    multi_stage->reuse_buffer(std::move(output));
+    CHECK(apply_input(*multi_stage, "+A -A +X -X") ==
+          apply_input(*reference, "+A -A +X -X"));
+  }
+}
+
+//--------------------------------------------------------------------
+
 TEST_CASE("Forwarding after timeout (#113)", "[Server]") {
   auto state = create_state(R"(
     !W Q{500ms} >> C
@@ -1331,3 +1424,644 @@ TEST_CASE("virtual-keys-toggle directive", "[Server]") {
   CHECK(state2.apply_input("+X -X") == "+X -X");
   REQUIRE(state2.stage_is_clear());
 }
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Timeouts are measured using time of input events", "[Server]") {
+  auto state = create_state(R"(
+    A{500ms} >> B
+    A >> C
+  )");
+  using namespace std::chrono_literals;
+
+  // released after 400ms, processed much later
+  auto time = Clock::now() - 1000ms;
+  CHECK(state.apply_input("+A", time) == "");
+  CHECK(state.timeout_start_at() == time);
+  CHECK(state.apply_input("-A", time + 400ms) == "+C -C");
+
+  // released after 600ms, processed before timeout was handled
+  time = Clock::now() - 1000ms;
+  CHECK(state.apply_input("+A", time) == "");
+  CHECK(state.apply_input("-A", time + 600ms) == "+B -B");
+  REQUIRE(state.stage_is_clear());
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Latency statistics", "[Server]") {
+  using namespace std::chrono_literals;
+  auto histogram = LatencyHistogram();
+  CHECK(histogram.count() == 0);
+  CHECK(histogram.percentile(0.5) == Duration::zero());
+
+  for (auto i = 0; i < 98; ++i)
+    histogram.add(100us);
+  histogram.add(5ms);
+  histogram.add(20ms);
+  CHECK(histogram.count() == 100);
+  CHECK(histogram.max() == Duration(20ms));
+  // bucket upper bounds are at most 25% above the value
+  CHECK(histogram.percentile(0.5) >= Duration(100us));
+  CHECK(histogram.percentile(0.5) <= Duration(125us));
+  CHECK(histogram.percentile(0.99) >= Duration(5ms));
+  CHECK(histogram.percentile(0.99) <= Duration(6250us));
+  CHECK(histogram.percentile(1.0) == Duration(20ms));
+
+  auto state = create_state(R"(
+    A >> B
+  )");
+  CHECK(state.apply_input("+A -A") == "+B -B");
+  const auto& statistics = state.statistics();
+  CHECK(statistics.counter(Statistics::Counter::input_events) == 2);
+  CHECK(statistics.counter(Statistics::Counter::output_events) == 2);
+  CHECK(statistics.latency(Statistics::Latency::translate).count() == 2);
+  CHECK(statistics.latency(Statistics::Latency::scheduled).count() == 0);
+  CHECK(statistics.format().find("translate") != std::string::npos);
+  CHECK(statistics.format().find("timeouts fired: 0") != std::string::npos);
+
+  // time from scheduling a flush until it was performed
+  state.schedule_flush(1ms);
+  std::this_thread::sleep_for(2ms);
+  state.flush_send_buffer();
+  const auto& scheduled = statistics.latency(Statistics::Latency::scheduled);
+  CHECK(scheduled.count() == 1);
+  CHECK(scheduled.max() >= Duration(2ms));
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Record input and output", "[Server]") {
+  const auto filename =
+    (std::filesystem::temp_directory_path() / "test-keymapper.kmrec").string();
+
+  auto state = create_state(R"(
+    A >> B
+  )");
+  auto recording = std::make_unique<RecordingWriter>();
+  REQUIRE(recording->open(filename));
+  state.set_recording(std::move(recording));
+  CHECK(state.apply_input("+A -A") == "+B -B");
+  state.set_recording(nullptr);
+
+  auto events = std::vector<RecordedEvent>();
+  REQUIRE(read_recording(filename, &events));
+  std::filesystem::remove(filename);
+
+  auto inputs = KeySequence();
+  auto outputs = KeySequence();
+  for (const auto& event : events) {
+    if (event.type == RecordedEvent::Type::input)
+      inputs.push_back(event.event);
+    else if (event.type == RecordedEvent::Type::output)
+      outputs.push_back(event.event);
+  }
+  CHECK(format_sequence(inputs) == "+A -A");
+  CHECK(format_sequence(outputs) == "+B -B");
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Replay recording with timeouts", "[Server]") {
+  const auto filename =
+    (std::filesystem::temp_directory_path() / "test-keymapper.kmrec").string();
+  const auto config = R"(
+    A{200ms} >> B
+    A >> X
+  )";
+
+  auto state = create_state(config);
+  auto recording = std::make_unique<RecordingWriter>();
+  REQUIRE(recording->open(filename));
+  state.set_recording(std::move(recording));
+  CHECK(state.apply_input("+A") == "");
+  CHECK(state.apply_timeout_reached() == "+B");
+  CHECK(state.apply_input("-A") == "-B");
+  CHECK(state.apply_input("+A") == "");
+  CHECK(state.apply_input("-A") == "+X -X");
+  state.set_recording(nullptr);
+
+  auto events = std::vector<RecordedEvent>();
+  REQUIRE(read_recording(filename, &events));
+  std::filesystem::remove(filename);
+
+  // recorded timeout is not injected twice
+  auto replayed = create_state(config);
+  auto outputs = KeySequence();
+  const auto begin = Clock::now();
+  for (const auto& event : events) {
+    if (event.type == RecordedEvent::Type::output)
+      outputs.push_back(event.event);
+    else
+      CHECK(replayed.replay_event(event, begin + event.time));
+  }
+  CHECK(format_sequence(outputs) == "+B -B +X -X");
+  CHECK(replayed.flush() == "+B -B +X -X");
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Varint encoding", "[Server]") {
+  const auto values = std::vector<uint64_t>{ 
+    0, 1, 127, 128, 300, 16383, 16384, 0xFFFFFFFF, 0xFFFFFFFFFFFFFFFF };
+  const auto signed_values = std::vector<int64_t>{ 
+    0, 1, -1, 63, -64, 64, -65, 0x7FFFFFFF, -0x7FFFFFFF - 1 };
+
+  auto s = Serializer();
+  for (auto value : values)
+    s.write_varint(value);
+  for (auto value : signed_values)
+    s.write_signed_varint(value);
+  s.write_varint(3);
+
+  // small values take a single byte
+  CHECK(s.data().size() == 1 + 1 + 1 + 2 + 2 + 2 + 3 + 5 + 10 +
+                           1 + 1 + 1 + 1 + 1 + 2 + 2 + 5 + 5 + 1);
+
+  auto d = Deserializer(s.data().data(), s.data().size());
+  for (auto value : values)
+    CHECK(d.read_varint() == value);
+  for (auto value : signed_values)
+    CHECK(d.read_signed_varint() == value);
+
+  // counts are bounded by the remaining data
+  CHECK(d.read_count() == 0);
+  CHECK(!d.can_read(1));
+  CHECK(d.read_varint() == 0);
+}
+
+//--------------------------------------------------------------------
+
+#if !defined(_WIN32)
+
+namespace {
+  // records the messages received by keymapperd
+  class ClientMessages : public IClientPort::MessageHandler {
+  public:
+    int configurations{ };
+    size_t contexts{ };
+    MultiStagePtr stage;
+    std::vector<std::vector<int>> active_contexts;
+
+    void on_configuration_message(MultiStagePtr stage) override {
+      ++configurations;
+      contexts = 0;
+      for (const auto& s : stage->stages())
+        contexts += s->contexts().size();
+      this->stage = std::move(stage);
+    }
+    void on_active_contexts_message(const std::vector<int>& context_indices) override {
+      active_contexts.push_back(context_indices);
+    }
+    void on_grab_device_filters_message(std::vector<GrabDeviceFilter> filters) override { }
+    void on_directives_message(const std::vector<std::string>& directives) override { }
+    void on_set_virtual_key_state_message(Key key, KeyState state) override { }
+    void on_validate_state_message() override { }
+    void on_request_next_key_info_message() override { }
+    void on_request_statistics_message() override { }
+    void on_request_mapping_profile_message(bool start) override { }
+    void on_request_trace_message(bool start) override { }
+    void on_inject_input_message(const KeySequence& sequence) override { }
+    void on_inject_output_message(const KeySequence& sequence) override { }
+  };
+
+  // ignores the messages received by keymapper
+  class ServerMessages : public ServerPort::MessageHandler {
+  public:
+    void on_execute_action_message(int action_index) override { }
+    void on_virtual_key_state_message(Key key, KeyState state) override { }
+    void on_next_key_info_message(const std::vector<Key>& keys, DeviceDesc device) override { }
+    void on_statistics_message(const std::string& statistics) override { }
+    void on_mapping_profile_message(
+      const std::vector<Stage::ContextProfile>& context_profiles) override { }
+    void on_trace_message(const std::vector<TraceRecord>& records) override { }
+  };
+
+  template<typename F> // bool()
+  bool accept_connection(ClientPort& client_port, F&& connect) {
+    if (!client_port.listen())
+      return false;
+    auto connected = false;
+    auto thread = std::thread([&]() { connected = connect(); });
+    const auto accepted = client_port.accept();
+    thread.join();
+    return (accepted && connected);
+  }
+
+  Config parse_config(const std::string& string) {
+    static auto parse = ParseConfig();
+    auto stream = std::stringstream(string);
+    return parse(stream);
+  }
+} // namespace
+
+TEST_CASE("Pass file descriptors along with messages", "[Server]") {
+  int sockets[2];
+  REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0);
+  for (auto socket : sockets)
+    ::fcntl(socket, F_SETFL, ::fcntl(socket, F_GETFL, 0) | O_NONBLOCK);
+  auto sender = Connection(sockets[0]);
+  auto receiver = Connection(sockets[1]);
+
+  // send the write ends of two pipes, followed by a message without
+  int pipes[2][2];
+  for (auto i = 0; i < 2; ++i) {
+    REQUIRE(::pipe(pipes[i]) == 0);
+    REQUIRE(sender.send_message([&](Serializer& s) { s.write(i); }, pipes[i][1]));
+    ::close(pipes[i][1]);
+  }
+  REQUIRE(sender.send_message([&](Serializer& s) { s.write(2); }));
+
+  // file descriptors are taken in the order they were sent
+  auto messages = std::vector<int>();
+  REQUIRE(receiver.read_messages(std::nullopt, [&](Deserializer& d) {
+    const auto index = d.read<int>();
+    const auto fd = receiver.take_file_descriptor();
+    messages.push_back(index);
+    if (index == 2) {
+      CHECK(!fd);
+      return;
+    }
+    REQUIRE(fd);
+    const auto c = static_cast<char>('0' + index);
+    CHECK(::write(*fd, &c, 1) == 1);
+    ::close(*fd);
+  }));
+  CHECK(messages == std::vector<int>{ 0, 1, 2 });
+
+  for (auto i = 0; i < 2; ++i) {
+    auto c = char{ };
+    CHECK(::read(pipes[i][0], &c, 1) == 1);
+    CHECK(c == '0' + i);
+    ::close(pipes[i][0]);
+  }
+}
+
+TEST_CASE("Cache configurations received from keymapper", "[Server]") {
+  auto client_port = ClientPort("keymapper-test-cache");
+  auto server_port = ServerPort("keymapper-test-cache");
+  REQUIRE(accept_connection(client_port, 
+    [&]() { return server_port.connect(); }));
+  auto client_messages = ClientMessages();
+  auto server_messages = ServerMessages();
+
+  // returns whether the configuration was applied without requesting it
+  const auto send_config = [&](char output) {
+    const auto configurations = client_messages.configurations;
+    REQUIRE(server_port.send_config(parse_config(
+      std::string("A >> ") + output)));
+    REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+    if (client_messages.configurations > configurations)
+      return true;
+
+    REQUIRE(server_port.read_messages(server_messages, std::nullopt));
+    REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+    CHECK(client_messages.configurations == configurations + 1);
+    return false;
+  };
+
+  // unknown configurations are requested, known are cached
+  CHECK(!send_config('B'));
+  CHECK(!send_config('C'));
+  CHECK(send_config('B'));
+  CHECK(send_config('C'));
+
+  // fill cache with eight configurations, most recently used is B
+  for (auto output = 'D'; output <= 'I'; ++output)
+    CHECK(!send_config(output));
+  CHECK(send_config('B'));
+
+  // least recently used configuration C is evicted
+  CHECK(!send_config('J'));
+  CHECK(send_config('B'));
+  CHECK(!send_config('C'));
+  CHECK(send_config('J'));
+}
+
+TEST_CASE("Read configurations in both encodings", "[Server]") {
+  auto client_port = ClientPort("keymapper-test-encoding");
+  auto server_port = ServerPort("keymapper-test-encoding");
+  REQUIRE(accept_connection(client_port, 
+    [&]() { return server_port.connect(); }));
+  auto client_messages = ClientMessages();
+  auto server_messages = ServerMessages();
+
+  const auto config = parse_config(R"(
+    Shift{A} >> B
+    C >> $(echo C)
+    [modifier = "!Shift"]
+    ContextActive >> D
+    [title = "Editor" device = "Keyboard"]
+    E >> F G
+    [stage]
+    B >> H
+  )");
+
+  auto stages = std::vector<MultiStagePtr>();
+  for (auto encoding : { configuration_encoding_fixed_width, 
+                         configuration_encoding_varint }) {
+    REQUIRE(server_port.send_config(config, encoding));
+    REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+    REQUIRE(server_port.read_messages(server_messages, std::nullopt));
+    REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+    REQUIRE(client_messages.stage);
+    stages.push_back(std::move(client_messages.stage));
+  }
+  CHECK(client_messages.configurations == 2);
+
+  // both encodings result in the same contexts
+  const auto& fixed_width = stages[0]->stages();
+  const auto& varint = stages[1]->stages();
+  REQUIRE(fixed_width.size() == 2);
+  REQUIRE(varint.size() == fixed_width.size());
+  for (auto i = 0u; i < fixed_width.size(); ++i) {
+    const auto& a = fixed_width[i]->contexts();
+    const auto& b = varint[i]->contexts();
+    REQUIRE(a.size() == b.size());
+    for (auto j = 0u; j < a.size(); ++j) {
+      REQUIRE(a[j].inputs.size() == b[j].inputs.size());
+      for (auto k = 0u; k < a[j].inputs.size(); ++k) {
+        CHECK(a[j].inputs[k].input == b[j].inputs[k].input);
+        CHECK(a[j].inputs[k].output_index == b[j].inputs[k].output_index);
+      }
+      CHECK(a[j].outputs == b[j].outputs);
+      REQUIRE(a[j].command_outputs.size() == b[j].command_outputs.size());
+      for (auto k = 0u; k < a[j].command_outputs.size(); ++k) {
+        CHECK(a[j].command_outputs[k].output == b[j].command_outputs[k].output);
+        CHECK(a[j].command_outputs[k].index == b[j].command_outputs[k].index);
+      }
+      CHECK(a[j].device_filter.string == b[j].device_filter.string);
+      CHECK(a[j].modifier_filter == b[j].modifier_filter);
+      CHECK(a[j].invert_modifier_filter == b[j].invert_modifier_filter);
+      CHECK(a[j].fallthrough == b[j].fallthrough);
+    }
+  }
+  CHECK(varint[0]->contexts().size() == 3);
+  CHECK(!varint[0]->contexts()[0].outputs.empty());
+  CHECK(!varint[0]->contexts()[2].device_filter.string.empty());
+}
+
+TEST_CASE("Delay active contexts until configuration was received", "[Server]") {
+  auto client_port = ClientPort("keymapper-test-delay");
+  auto host = Host("keymapper-test-delay");
+  auto connection = Connection();
+  REQUIRE(accept_connection(client_port, [&]() {
+    connection = host.connect();
+    return static_cast<bool>(connection);
+  }));
+  auto client_messages = ClientMessages();
+
+  // an empty configuration takes four bytes
+  const auto empty_size = uint64_t{ 4 };
+  const auto send_hash = [&](uint64_t hash, uint64_t size) {
+    REQUIRE(connection.send_message([&](Serializer& s) {
+      s.write(MessageType::configuration_hash);
+      s.write(hash);
+      s.write(size);
+    }));
+  };
+  const auto send_configuration = [&](uint64_t hash) {
+    REQUIRE(connection.send_message([&](Serializer& s) {
+      s.write(MessageType::configuration);
+      s.write(hash);
+      s.write(empty_size);
+      s.write(configuration_encoding);
+      s.write_varint(0);
+      s.write_varint(0);
+      s.write_varint(0);
+    }));
+  };
+  const auto read_requests = [&]() {
+    auto hashes = std::vector<uint64_t>();
+    connection.read_messages(std::nullopt, [&](Deserializer& d) {
+      if (d.read<MessageType>() == MessageType::request_configuration) {
+        hashes.push_back(d.read<uint64_t>());
+        d.read<uint64_t>();
+        d.read<bool>();
+      }
+    });
+    return hashes;
+  };
+
+  // configuration is replaced while it is requested
+  send_hash(1, empty_size);
+  REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+  send_hash(2, empty_size);
+  REQUIRE(connection.send_message([&](Serializer& s) {
+    s.write(MessageType::active_contexts);
+    s.write_varint(1);
+    s.write_varint(0);
+  }));
+  REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+  CHECK(read_requests() == std::vector<uint64_t>{ 1, 2 });
+  CHECK(client_messages.active_contexts.empty());
+
+  // reply to the replaced request is ignored
+  send_configuration(1);
+  REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+  CHECK(client_messages.configurations == 0);
+  CHECK(client_messages.active_contexts.empty());
+
+  // active contexts are applied after the configuration
+  send_configuration(2);
+  REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+  CHECK(client_messages.configurations == 1);
+  REQUIRE(client_messages.active_contexts.size() == 1);
+  CHECK(client_messages.active_contexts[0] == std::vector<int>{ 0 });
+
+  // ignored configuration was not cached
+  send_hash(1, empty_size);
+  REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+  CHECK(read_requests() == std::vector<uint64_t>{ 1 });
+  CHECK(client_messages.configurations == 1);
+
+  // without a pending request, active contexts are applied immediately
+  send_configuration(1);
+  REQUIRE(connection.send_message([&](Serializer& s) {
+    s.write(MessageType::active_contexts);
+    s.write_varint(0);
+  }));
+  REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+  CHECK(client_messages.configurations == 2);
+  REQUIRE(client_messages.active_contexts.size() == 2);
+  CHECK(client_messages.active_contexts[1].empty());
+
+  // cached configuration is used when hash and size match
+  send_hash(2, empty_size);
+  REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+  CHECK(client_messages.configurations == 3);
+
+  // a configuration with the same hash but a different size is requested
+  send_hash(2, empty_size + 1);
+  REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+  CHECK(read_requests() == std::vector<uint64_t>{ 2 });
+  CHECK(client_messages.configurations == 3);
+}
+
+TEST_CASE("Send changes of active contexts", "[Server]") {
+  auto client_port = ClientPort("keymapper-test-delta");
+  auto server_port = ServerPort("keymapper-test-delta");
+  REQUIRE(accept_connection(client_port, 
+    [&]() { return server_port.connect(); }));
+  auto client_messages = ClientMessages();
+
+  // sent in full or as changes, depending on which is shorter
+  const auto active_contexts = std::vector<std::vector<int>>{
+    { }, { 0 }, { 0, 1, 2, 3, 4, 5, 6, 7 }, { 0, 1, 2, 3, 4, 5, 7 },
+    { 0, 2, 3, 4, 5, 7, 8 }, { 0, 2, 3, 4, 5, 7, 8 }, { 9, 10 },
+    { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 }, { 1, 2, 3, 4, 5, 6, 7, 8, 9, 11 },
+    { 0, 2, 4, 6, 8 }, { 0 }, { },
+  };
+  for (const auto& indices : active_contexts) {
+    REQUIRE(server_port.send_active_contexts(indices));
+    REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+    REQUIRE(!client_messages.active_contexts.empty());
+    CHECK(client_messages.active_contexts.back() == indices);
+  }
+  CHECK(client_messages.active_contexts.size() == active_contexts.size());
+}
+
+TEST_CASE("Apply only the latest of consecutive active contexts", "[Server]") {
+  auto client_port = ClientPort("keymapper-test-latest");
+  auto server_port = ServerPort("keymapper-test-latest");
+  REQUIRE(accept_connection(client_port, 
+    [&]() { return server_port.connect(); }));
+  auto client_messages = ClientMessages();
+
+  // intermediate contexts received at once are skipped
+  REQUIRE(server_port.send_active_contexts({ 0 }));
+  REQUIRE(server_port.send_active_contexts({ 0, 1 }));
+  REQUIRE(server_port.send_active_contexts({ 2 }));
+  REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+  REQUIRE(client_messages.active_contexts.size() == 1);
+  CHECK(client_messages.active_contexts[0] == std::vector<int>{ 2 });
+
+  // but applied before other messages
+  REQUIRE(server_port.send_active_contexts({ 3 }));
+  REQUIRE(server_port.send_validate_state());
+  REQUIRE(server_port.send_active_contexts({ 3, 4 }));
+  REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+  REQUIRE(client_messages.active_contexts.size() == 3);
+  CHECK(client_messages.active_contexts[1] == std::vector<int>{ 3 });
+  CHECK(client_messages.active_contexts[2] == std::vector<int>{ 3, 4 });
+}
+
+#if defined(__linux__)
+
+TEST_CASE("Pass large configuration in shared memory", "[Server]") {
+  // serialized to more than 64 KiB
+  auto string = std::string();
+  for (auto i = 0; i < 1000; ++i)
+    string += "[title = \"window " + std::to_string(i) + "\"]\n"
+              "A >> B C D E F G H I J K L M N O P Q R S T U V W X Y Z\n";
+
+  auto client_port = ClientPort("keymapper-test-shared");
+  auto server_port = ServerPort("keymapper-test-shared");
+  REQUIRE(accept_connection(client_port, 
+    [&]() { return server_port.connect(); }));
+  auto client_messages = ClientMessages();
+  auto server_messages = ServerMessages();
+
+  // active contexts are delayed until configuration was received
+  REQUIRE(server_port.send_config(parse_config(string)));
+  REQUIRE(server_port.send_active_contexts({ 1, 3 }));
+  REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+  CHECK(client_messages.configurations == 0);
+  CHECK(client_messages.active_contexts.empty());
+
+  REQUIRE(server_port.read_messages(server_messages, std::nullopt));
+  REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+  CHECK(client_messages.configurations == 1);
+  CHECK(client_messages.contexts == 1000);
+  REQUIRE(client_messages.active_contexts.size() == 1);
+  CHECK(client_messages.active_contexts[0] == std::vector<int>{ 1, 3 });
+}
+
+TEST_CASE("Fall back to socket when reading shared configuration failed", "[Server]") {
+  auto client_port = ClientPort("keymapper-test-fallback");
+  auto host = Host("keymapper-test-fallback");
+  auto connection = Connection();
+  REQUIRE(accept_connection(client_port, [&]() {
+    connection = host.connect();
+    return static_cast<bool>(connection);
+  }));
+  auto client_messages = ClientMessages();
+
+  const auto hash = uint64_t{ 1234 };
+  const auto size = uint64_t{ 1024 };
+  const auto read_request = [&]() {
+    auto allow_shared = std::optional<bool>();
+    connection.read_messages(std::nullopt, [&](Deserializer& d) {
+      if (d.read<MessageType>() == MessageType::request_configuration &&
+          d.read<uint64_t>() == hash && d.read<uint64_t>() == size)
+        allow_shared = d.read<bool>();
+    });
+    return allow_shared;
+  };
+
+  REQUIRE(connection.send_message([&](Serializer& s) {
+    s.write(MessageType::configuration_hash);
+    s.write(hash);
+    s.write(size);
+  }));
+  REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+  CHECK(read_request() == true);
+
+  // memory which is not sealed is rejected and requested through the socket
+  const auto fd = ::memfd_create("keymapper-test", 0);
+  REQUIRE(fd >= 0);
+  REQUIRE(::ftruncate(fd, size) == 0);
+  REQUIRE(connection.send_message([&](Serializer& s) {
+    s.write(MessageType::shared_configuration);
+    s.write(hash);
+    s.write(size);
+  }, fd));
+  ::close(fd);
+  REQUIRE(connection.send_message([&](Serializer& s) {
+    s.write(MessageType::active_contexts);
+    s.write_varint(1);
+    s.write_varint(2);
+  }));
+  REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+  CHECK(read_request() == false);
+  CHECK(client_messages.active_contexts.empty());
+
+  // an unsupported configuration no longer delays the active contexts
+  REQUIRE(connection.send_message([&](Serializer& s) {
+    s.write(MessageType::configuration);
+    s.write(hash);
+    s.write(size);
+    s.write(static_cast<uint8_t>(configuration_encoding + 1));
+    s.write(std::vector<char>(size - 1).data(), size - 1);
+  }));
+  REQUIRE(client_port.read_messages(client_messages, std::nullopt));
+  CHECK(client_messages.configurations == 0);
+  REQUIRE(client_messages.active_contexts.size() == 1);
+  CHECK(client_messages.active_contexts[0] == std::vector<int>{ 2 });
+}
+
+#endif // defined(__linux__)
+
+#endif // !defined(_WIN32)
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Keep profiling mappings when configuration is replaced", "[Server]") {
+  auto state = create_state(R"(
+    @profile-mappings
+    A >> B
+  )");
+  REQUIRE(state.stages().front()->profiling());
+  CHECK(state.apply_input("+A") == "+B");
+  CHECK(state.stages().front()->profile()[0][0].matches == 1);
+
+  // the profile restarts with the contexts of the new configuration
+  auto [multi_stage, directives] = create_multi_stage(R"(
+    A >> C
+    B >> D
+  )");
+  state.set_configuration(std::move(multi_stage), std::move(directives));
+  REQUIRE(state.stages().front()->profiling());
+  REQUIRE(state.stages().front()->profile()[0].size() == 2);
+  CHECK(state.stages().front()->profile()[0][0].matches == 0);
+}
@@ -0,0 +1,181 @@
+
+#include "test.h"
+#include "server/unix/Pipeline.h"
+#include "server/unix/VirtualDevices.h"
+#include "server/Statistics.h"
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <poll.h>
+
+// the devices are replaced, so input can be fed to the pipeline
+// and its output observed
+class GrabbedDevicesImpl { };
+class VirtualDevicesImpl { };
+
+namespace {
+  using Event = GrabbedDevices::Event;
+
+  std::mutex g_mutex;
+  std::deque<Event> g_input;
+  std::vector<int> g_forwarded;
+  bool g_slow_output;
+
+  void add_input(int first_code, int count) {
+    auto lock = std::lock_guard(g_mutex);
+    for (auto code = first_code; code < first_code + count; ++code)
+      g_input.push_back({ 0, 0, code, 1, Clock::now() });
+  }
+
+  bool input_read() {
+    auto lock = std::lock_guard(g_mutex);
+    return g_input.empty();
+  }
+
+  void wait_until_input_read() {
+    while (!input_read())
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  std::vector<int> get_forwarded() {
+    auto lock = std::lock_guard(g_mutex);
+    return g_forwarded;
+  }
+
+  void reset_devices() {
+    auto lock = std::lock_guard(g_mutex);
+    g_input.clear();
+    g_forwarded.clear();
+    g_slow_output = false;
+  }
+} // namespace
+
+GrabbedDevices::GrabbedDevices() = default;
+GrabbedDevices::~GrabbedDevices() = default;
+
+bool GrabbedDevices::update_devices() {
+  return false;
+}
+
+auto GrabbedDevices::read_input_event(std::optional<Duration> timeout,
+    int interrupt_fd) -> std::pair<bool, std::optional<Event>> {
+  {
+    auto lock = std::lock_guard(g_mutex);
+    if (!g_input.empty()) {
+      const auto event = g_input.front();
+      g_input.pop_front();
+      return { true, event };
+    }
+  }
+  auto pfd = pollfd{ interrupt_fd, POLLIN, 0 };
+  ::poll(&pfd, 1, 1);
+  return { true, std::nullopt };
+}
+
+VirtualDevices::VirtualDevices() = default;
+VirtualDevices::~VirtualDevices() = default;
+
+bool VirtualDevices::send_key_event(const KeyEvent& event) {
+  return true;
+}
+
+bool VirtualDevices::forward_event(int device_index, int type, int code, int value) {
+  auto lock = std::lock_guard(g_mutex);
+  if (g_slow_output)
+    std::this_thread::sleep_for(std::chrono::microseconds(10));
+  g_forwarded.push_back(code);
+  return true;
+}
+
+bool VirtualDevices::flush() {
+  return true;
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Restart pipeline with queued input", "[Pipeline]") {
+  reset_devices();
+  auto grabbed_devices = GrabbedDevices();
+  auto virtual_devices = VirtualDevices();
+  auto statistics = Statistics();
+  auto pipeline = Pipeline();
+
+  add_input(0, 4);
+  REQUIRE(pipeline.start(grabbed_devices, virtual_devices, statistics));
+  const auto [succeeded, input] =
+    pipeline.read_input_event(std::chrono::seconds(1), -1);
+  CHECK(succeeded);
+  REQUIRE(input);
+  CHECK(input->code == 0);
+  wait_until_input_read();
+  CHECK(!pipeline.take_queued_input());
+
+  // input which was read before stopping is kept
+  pipeline.stop();
+  CHECK(!pipeline.running());
+  auto queued = std::vector<int>();
+  while (const auto input = pipeline.take_queued_input())
+    queued.push_back(input->code);
+  CHECK(queued == std::vector<int>{ 1, 2, 3 });
+
+  // a restarted pipeline only returns newer input
+  add_input(4, 1);
+  REQUIRE(pipeline.start(grabbed_devices, virtual_devices, statistics));
+  const auto [restarted, newer] =
+    pipeline.read_input_event(std::chrono::seconds(1), -1);
+  CHECK(restarted);
+  REQUIRE(newer);
+  CHECK(newer->code == 4);
+
+  // output is written before stopping
+  for (auto code = 0; code < 3; ++code)
+    CHECK(pipeline.forward_event({ 0, 0, code, 1, Clock::now() }));
+  pipeline.stop();
+  CHECK(get_forwarded() == std::vector<int>{ 0, 1, 2 });
+}
+
+//--------------------------------------------------------------------
+
+TEST_CASE("Block while pipeline queues are full", "[Pipeline]") {
+  reset_devices();
+  auto grabbed_devices = GrabbedDevices();
+  auto virtual_devices = VirtualDevices();
+  auto statistics = Statistics();
+  auto pipeline = Pipeline();
+
+  // more input than fits in the queue
+  const auto count = 3000;
+  add_input(0, count);
+  REQUIRE(pipeline.start(grabbed_devices, virtual_devices, statistics));
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  CHECK(!input_read());
+
+  // reader continues once input was processed,
+  // output is forwarded slower than it is pushed
+  auto expected = std::vector<int>();
+  auto codes = std::vector<int>();
+  for (auto i = 0; i < count; ++i)
+    expected.push_back(i);
+  {
+    auto lock = std::lock_guard(g_mutex);
+    g_slow_output = true;
+  }
+  while (codes.size() < count) {
+    const auto [succeeded, input] =
+      pipeline.read_input_event(std::chrono::seconds(1), -1);
+    REQUIRE(succeeded);
+    REQUIRE(input);
+    codes.push_back(input->code);
+    CHECK(pipeline.forward_event(*input));
+  }
+  pipeline.stop();
+  CHECK(codes == expected);
+  CHECK(get_forwarded() == expected);
+
+  // stopping while reader waits for the full queue
+  add_input(0, count);
+  REQUIRE(pipeline.start(grabbed_devices, virtual_devices, statistics));
+  std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  pipeline.stop();
+  CHECK(!pipeline.running());
+}